@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+
+// The balance is atomic so that commands on the same account can run on
+// different threads without a lock. withdraw() only succeeds if the balance
+// it checked against the overdraft limit is still the current one.
+class BankAccount {
+    std::atomic<int> balance{};
+    int overdraft_limit{-500};
+    bool logging{true};
+
+    // Takes amount off the balance unless that would go past the overdraft
+    // limit, in which case the balance is left alone.
+    bool subtract(int amount, int& new_balance) {
+        int current = balance.load(std::memory_order_acquire);
+        do {
+            if(current-amount < overdraft_limit) {
+                return false;
+            }
+            // On failure current is reloaded, so the limit is checked again.
+        } while(!balance.compare_exchange_weak(current, current-amount,
+                                               std::memory_order_acq_rel,
+                                               std::memory_order_acquire));
+        new_balance = current-amount;
+        return true;
+    }
+public:
+    BankAccount() = default;
+    // Copies aren't atomic with respect to concurrent changes to other.
+    BankAccount(const BankAccount& other)
+        : balance{other.get_balance()},
+          overdraft_limit{other.overdraft_limit},
+          logging{other.logging} {}
+    BankAccount& operator=(const BankAccount& other) {
+        balance.store(other.get_balance(), std::memory_order_relaxed);
+        overdraft_limit = other.overdraft_limit;
+        logging = other.logging;
+        return *this;
+    }
+
+    int get_balance() const {
+        return balance.load(std::memory_order_acquire);
+    }
+    // Printing every operation is slow, so batch processing turns it off.
+    void set_logging(bool logging) {
+        this->logging = logging;
+    }
+
+    void deposit(int amount) {
+        int new_balance = balance.fetch_add(amount, std::memory_order_acq_rel) + amount;
+        if(logging) {
+            std::cout << "Deposited: " << amount
+                        << ", balance is: " << new_balance << std::endl;
+        }
+    }
+    bool withdraw(int amount) {
+        int new_balance;
+        if(!subtract(amount, new_balance)) {
+            return false;
+        }
+        if(logging) {
+            std::cout << "Withdrew: " << amount
+                        << ", balance is: " << new_balance << std::endl;
+        }
+        return true;
+    }
+    // Reverses an earlier deposit. The money may have been spent since, so
+    // like withdraw() this fails if it would go past the overdraft limit.
+    bool revert_deposit(int amount) {
+        int new_balance;
+        if(!subtract(amount, new_balance)) {
+            return false;
+        }
+        if(logging) {
+            std::cout << "Reverted deposit: " << amount
+                        << ", balance is: " << new_balance << std::endl;
+        }
+        return true;
+    }
+    // Reverses an earlier withdrawal, which can't fail.
+    void revert_withdrawal(int amount) {
+        int new_balance = balance.fetch_add(amount, std::memory_order_acq_rel) + amount;
+        if(logging) {
+            std::cout << "Reverted withdrawal: " << amount
+                        << ", balance is: " << new_balance << std::endl;
+        }
+    }
+};
\ No newline at end of file
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vector>
+#include "BankAccount.h"
+
+class Command {
+public:
+    virtual ~Command() = default;
+    virtual void call() = 0;
+    // Returns false if it couldn't all be undone.
+    virtual bool undo() = 0;
+};
+
+class BankAccountCommand : public Command {
+    BankAccount& account;
+    int amount;
+    bool succeeded{false};
+public:
+    enum class Action {deposit, withdraw} action;
+
+    BankAccountCommand(BankAccount &account, Action action, int amount)
+        : account(account), amount(amount), action(action) {}
+
+    BankAccount& get_account() const {
+        return account;
+    }
+    int get_amount() const {
+        return amount;
+    }
+    bool get_succeeded() const {
+        return succeeded;
+    }
+    void set_succeeded(bool succeeded) {
+        this->succeeded = succeeded;
+    }
+
+    void call() override {
+        switch(action) {
+            case Action::deposit: {
+                account.deposit(amount);
+                succeeded = true;
+                break;
+            }
+            case Action::withdraw: {
+                succeeded = account.withdraw(amount);
+                break;
+            }
+        }
+    }
+    // Only reverses the balance, the deposit or withdrawal isn't repeated.
+    // Undoing a deposit fails if the money has been spent since and taking it
+    // back would go past the overdraft limit, in which case the command still
+    // counts as succeeded.
+    bool undo() override {
+        if(!succeeded) {
+            return true;
+        }
+        switch(action) {
+            case Action::deposit: {
+                if(!account.revert_deposit(amount)) {
+                    return false;
+                }
+                break;
+            }
+            case Action::withdraw: {
+                account.revert_withdrawal(amount);
+                break;
+            }
+        }
+        succeeded = false;
+        return true;
+    }
+};
+
+class CompositeBankAccountCommand : public Command {
+    std::vector<BankAccountCommand> commands;
+protected:
+    // Indices of the commands that succeeded, in the order they were called.
+    // Undoing walks it backwards once, so it's linear in the commands undone.
+    std::vector<size_t> undo_log;
+
+    // Stops at the first command that can't be undone, leaving it and those
+    // before it in the log.
+    bool rollback() {
+        while(!undo_log.empty()) {
+            if(!commands[undo_log.back()].undo()) {
+                return false;
+            }
+            undo_log.pop_back();
+        }
+        return true;
+    }
+public:
+    CompositeBankAccountCommand(std::initializer_list<BankAccountCommand> commands)
+        : commands{commands} {}
+    CompositeBankAccountCommand(std::vector<BankAccountCommand> commands)
+        : commands{std::move(commands)} {}
+
+    auto& get_commands() {
+        return commands;
+    }
+
+    void call() override {
+        undo_log.clear();
+        for(size_t i{}; i < commands.size(); ++i) {
+            commands[i].call();
+            if(commands[i].get_succeeded()) {
+                undo_log.push_back(i);
+            }
+        }
+    }
+    bool undo() override {
+        return rollback();
+    }
+};
+
+// All or nothing: if any command fails, those before it are undone. If one of
+// those can't be undone either, get_succeeded() is false but undo_log still
+// holds the commands that remain in effect.
+class DependantCompositeCommand : public CompositeBankAccountCommand {
+public:
+    DependantCompositeCommand(const std::initializer_list<BankAccountCommand> &commands)
+        : CompositeBankAccountCommand(commands) {}
+    DependantCompositeCommand(std::vector<BankAccountCommand> commands)
+        : CompositeBankAccountCommand(std::move(commands)) {}
+
+    bool get_succeeded() {
+        return !get_commands().empty() && undo_log.size() == get_commands().size();
+    }
+
+    void call() override {
+        undo_log.clear();
+        auto& commands = get_commands();
+        for(size_t i{}; i < commands.size(); ++i) {
+            commands[i].call();
+            if(!commands[i].get_succeeded()) {
+                rollback();
+                for(; i < commands.size(); ++i) {
+                    commands[i].set_succeeded(false);
+                }
+                return;
+            }
+            undo_log.push_back(i);
+        }
+    }
+};
+
+// Safe to call from many threads at once, as long as each uses its own
+// command. There's no lock: the withdrawal is checked and applied with a
+// single compare-and-swap, retried if another thread changed the balance in
+// between, and the deposit can't fail. While a transfer is in flight the
+// money has left one account but not yet reached the other.
+class MoneyTransferCommand : public DependantCompositeCommand {
+public:
+    MoneyTransferCommand(BankAccount& from, BankAccount& to, int amount)
+        : DependantCompositeCommand{{from, BankAccountCommand::Action::withdraw, amount},
+                                    {to, BankAccountCommand::Action::deposit, amount}} {}
+};
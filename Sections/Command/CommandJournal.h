@@ -0,0 +1,202 @@
+#pragma once
+
+// The journal memory maps its file, which is only implemented for POSIX systems.
+#if defined(__unix__) || defined(__APPLE__)
+#define COMMAND_JOURNAL_SUPPORTED
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Command.h"
+
+// Append-only record of executed BankAccountCommands, kept in a memory mapped
+// file. Records are written straight into the mapping and made durable in
+// groups: every group_size appends, or on commit(), the new records are
+// flushed to disk and only then counted as committed in the header. After a
+// crash, records that weren't committed are ignored.
+// Replaying the journal rebuilds account balances, and undos are journalled
+// as well, so they keep working across restarts.
+class CommandJournal {
+public:
+    struct Record {
+        uint64_t sequence;
+        uint32_t account;
+        int32_t amount;
+        uint8_t action; // BankAccountCommand::Action.
+        uint8_t undo; // Reverses the latest command that hasn't been undone.
+        uint8_t padding[6];
+    };
+private:
+    struct Header {
+        char magic[8];
+        uint64_t committed; // Records that are safely on disk.
+    };
+    static constexpr char magic[8] = {'B', 'A', 'N', 'K', 'J', 'N', 'L', '1'};
+
+    // Close the file and unmap it when the journal is destroyed, or when the
+    // constructor throws part way through.
+    struct File {
+        int fd{-1};
+        ~File() {
+            if(fd != -1) {
+                close(fd);
+            }
+        }
+    };
+    struct Mapping {
+        char* address{};
+        size_t size{};
+        ~Mapping() {
+            if(address) {
+                munmap(address, size);
+            }
+        }
+    };
+
+    File file;
+    Mapping mapping;
+    size_t capacity{}; // In records.
+    size_t count{}; // Records written, committed or not.
+    size_t committed{};
+    const size_t group_size;
+
+    Header& header() const {
+        return *reinterpret_cast<Header*>(mapping.address);
+    }
+    Record* records() const {
+        return reinterpret_cast<Record*>(mapping.address + sizeof(Header));
+    }
+    static size_t file_size(size_t capacity) {
+        return sizeof(Header) + capacity * sizeof(Record);
+    }
+    static void check(bool ok, const char* what) {
+        if(!ok) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+    }
+    void map(size_t new_capacity) {
+        if(mapping.address) {
+            check(munmap(mapping.address, mapping.size) == 0, "munmap");
+            mapping.address = nullptr;
+        }
+        check(ftruncate(file.fd, file_size(new_capacity)) == 0, "ftruncate");
+        void* address = mmap(nullptr, file_size(new_capacity), PROT_READ | PROT_WRITE,
+                             MAP_SHARED, file.fd, 0);
+        check(address != MAP_FAILED, "mmap");
+        mapping.address = static_cast<char*>(address);
+        mapping.size = file_size(new_capacity);
+        capacity = new_capacity;
+    }
+    // msync needs a page aligned address.
+    void sync(size_t begin, size_t end) {
+        auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        begin -= begin % page;
+        check(msync(mapping.address + begin, end - begin, MS_SYNC) == 0, "msync");
+    }
+public:
+    explicit CommandJournal(const std::string& path, size_t group_size = 256)
+        : group_size{group_size} {
+        file.fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        check(file.fd != -1, "open");
+        struct stat status{};
+        check(fstat(file.fd, &status) == 0, "fstat");
+        auto existing = static_cast<size_t>(status.st_size);
+        if(existing < sizeof(Header)) {
+            map(4096);
+            std::memcpy(header().magic, magic, sizeof(magic));
+            header().committed = 0;
+            sync(0, sizeof(Header));
+        } else {
+            map(std::max<size_t>((existing - sizeof(Header)) / sizeof(Record), 4096));
+            if(std::memcmp(header().magic, magic, sizeof(magic)) != 0) {
+                throw std::runtime_error("Not a command journal: " + path);
+            }
+            committed = count = header().committed;
+        }
+    }
+    ~CommandJournal() {
+        try {
+            commit();
+        } catch(...) {}
+    }
+    CommandJournal(const CommandJournal&) = delete;
+    CommandJournal& operator=(const CommandJournal&) = delete;
+
+    // Only executed commands that succeeded should be appended.
+    void append(uint32_t account, const BankAccountCommand& command, bool undo = false) {
+        if(count == capacity) {
+            commit();
+            map(capacity * 2);
+        }
+        Record& record = records()[count];
+        record = Record{count, account, command.get_amount(),
+                        static_cast<uint8_t>(command.action), undo, {}};
+        if(++count - committed >= group_size) {
+            commit();
+        }
+    }
+    // Makes everything appended so far durable.
+    void commit() {
+        if(count == committed) {
+            return;
+        }
+        sync(file_size(committed), file_size(count));
+        header().committed = count;
+        sync(0, sizeof(Header));
+        committed = count;
+    }
+
+    size_t size() const {
+        return count;
+    }
+    const Record& operator[](size_t index) const {
+        return records()[index];
+    }
+
+    // Applies every record in order, creating accounts as needed. Created
+    // accounts have logging turned off.
+    void replay(std::unordered_map<uint32_t, BankAccount>& accounts) const {
+        for(size_t i{}; i < count; ++i) {
+            const Record& record = records()[i];
+            auto [it, created] = accounts.try_emplace(record.account);
+            auto& account = it->second;
+            if(created) {
+                account.set_logging(false);
+            }
+            bool deposit = static_cast<BankAccountCommand::Action>(record.action) ==
+                           BankAccountCommand::Action::deposit;
+            if(record.undo && deposit) {
+                account.revert_deposit(record.amount);
+            } else if(record.undo) {
+                account.revert_withdrawal(record.amount);
+            } else if(deposit) {
+                account.deposit(record.amount);
+            } else {
+                account.withdraw(record.amount);
+            }
+        }
+    }
+    // Index of the latest command that hasn't been undone, or size() if there isn't one.
+    size_t last_undoable() const {
+        size_t undos{};
+        for(size_t i{count}; i > 0; --i) {
+            if(records()[i-1].undo) {
+                ++undos;
+            } else if(undos > 0) {
+                --undos;
+            } else {
+                return i-1;
+            }
+        }
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include "Command.h"
+#include "CommandJournal.h"
+
+// Bounded lock-free queue for multiple producers and a single consumer.
+// Each cell carries a sequence number that tells producers when it's free to
+// write and the consumer when it's ready to read, so neither side locks.
+template <typename T>
+class MpscQueue {
+    struct Cell {
+        std::atomic<size_t> sequence;
+        std::optional<T> value; // T needn't be default constructible or assignable.
+    };
+
+    std::vector<Cell> cells;
+    const size_t mask;
+    // Kept on separate cache lines so producers and the consumer don't contend.
+    alignas(64) std::atomic<size_t> tail{}; // Next position to push to.
+    alignas(64) size_t head{}; // Next position to pop from, consumer only.
+public:
+    // Capacity must be a power of two.
+    explicit MpscQueue(size_t capacity) : cells(capacity), mask{capacity - 1} {
+        if(capacity == 0 || (capacity & mask) != 0) {
+            throw std::invalid_argument("Capacity must be a power of two");
+        }
+        for(size_t i{}; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the queue is full. Safe to call from any thread.
+    bool try_push(T value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true) {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+            if(difference == 0) {
+                if(tail.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(difference < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value.emplace(std::move(value));
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+    // Waits for space if the queue is full.
+    void push(T value) {
+        while(!try_push(value)) {
+            std::this_thread::yield();
+        }
+    }
+
+    // Whether consume() would find a value. Must only be called from the
+    // consumer thread.
+    bool ready() const {
+        return cells[head & mask].sequence.load(std::memory_order_acquire) == head + 1;
+    }
+
+    // Passes up to max_count values to func in FIFO order and returns how many
+    // there were. Must only be called from the consumer thread.
+    template <typename Func>
+    size_t consume(Func&& func, size_t max_count) {
+        size_t count{};
+        for(; count < max_count; ++count) {
+            Cell& cell = cells[head & mask];
+            if(cell.sequence.load(std::memory_order_acquire) != head + 1) {
+                break; // Empty, or the producer hasn't finished writing.
+            }
+            func(*cell.value);
+            cell.value.reset();
+            cell.sequence.store(head + cells.size(), std::memory_order_release);
+            ++head;
+        }
+        return count;
+    }
+};
+
+// Executes BankAccountCommands submitted from any number of threads on a
+// single consumer thread, in batches. Instead of printing every operation the
+// outcome is recorded, and the log is written out later by flush_log(), away
+// from the hot path. Accounts should have logging turned off.
+// The log holds at most log_capacity entries. Given a stream with
+// set_log_stream(), a full log is handed to a writer thread, like Mediator's
+// AsyncLogger, which formats and writes it while the consumer carries on
+// recording into an empty one. The consumer only waits if the writer falls a
+// whole log behind. Without a stream the entries that don't fit are counted.
+// Given a journal, the processor first recovers the accounts from it, then
+// appends every command that succeeds, in the order they're executed, so
+// replaying the journal after a restart gives the same balances. Records are
+// committed in the journal's groups, and whenever the queue runs dry.
+class CommandProcessor {
+public:
+    struct LogEntry {
+        BankAccountCommand::Action action;
+        int amount;
+        int balance; // After the command.
+        bool succeeded;
+    };
+private:
+    MpscQueue<BankAccountCommand> queue;
+    const size_t batch_size;
+    const size_t log_capacity;
+    std::vector<LogEntry> log; // Consumer only.
+    size_t log_dropped{};
+    // Shared with the writer thread, under log_mutex.
+    std::ostream* log_stream{};
+    std::mutex log_mutex;
+    std::condition_variable log_wake, log_idle;
+    std::vector<LogEntry> full_log; // Handed to the writer, empty once taken.
+    bool log_writing{false};
+    bool log_stopping{false};
+    std::thread log_writer;
+    std::atomic<size_t> processed{};
+#ifdef COMMAND_JOURNAL_SUPPORTED
+    CommandJournal* journal{};
+    std::unordered_map<const BankAccount*, uint32_t> account_ids; // Fixed once attached.
+#endif
+
+    static void write_log(std::ostream& os, const std::vector<LogEntry>& entries) {
+        for(const auto& entry : entries) {
+            bool deposit = entry.action == BankAccountCommand::Action::deposit;
+            if(!entry.succeeded) {
+                os << "Failed to withdraw: " << entry.amount << '\n';
+            } else {
+                os << (deposit ? "Deposited: " : "Withdrew: ") << entry.amount
+                   << ", balance is: " << entry.balance << '\n';
+            }
+        }
+        os.flush();
+    }
+    void run_log_writer() {
+        std::vector<LogEntry> batch;
+        batch.reserve(log_capacity);
+        std::unique_lock lock{log_mutex};
+        while(true) {
+            log_wake.wait(lock, [this]() { return log_stopping || !full_log.empty(); });
+            if(full_log.empty()) { // Stopping, and everything's been written.
+                return;
+            }
+            // Leaves the writer's empty vector in its place for the next hand-off.
+            batch.swap(full_log);
+            log_writing = true;
+            lock.unlock();
+            write_log(*log_stream, batch);
+            batch.clear();
+            lock.lock();
+            log_writing = false;
+            log_idle.notify_all();
+        }
+    }
+    // Consumer only. Waits if the writer hasn't taken the previous log yet.
+    void hand_off_log() {
+        {
+            std::unique_lock lock{log_mutex};
+            log_idle.wait(lock, [this]() { return full_log.empty(); });
+            full_log.swap(log);
+        }
+        log_wake.notify_one();
+    }
+    void stop_log_writer() {
+        if(!log_writer.joinable()) {
+            return;
+        }
+        if(!log.empty()) {
+            hand_off_log();
+        }
+        {
+            std::lock_guard lock{log_mutex};
+            log_stopping = true;
+        }
+        log_wake.notify_one();
+        log_writer.join();
+        log_stopping = false;
+    }
+
+    void check_journalled([[maybe_unused]] const BankAccountCommand& command) const {
+#ifdef COMMAND_JOURNAL_SUPPORTED
+        if(journal && account_ids.count(&command.get_account()) == 0) {
+            throw std::invalid_argument("Account isn't one of the journalled accounts");
+        }
+#endif
+    }
+public:
+    explicit CommandProcessor(size_t capacity = 1 << 16, size_t batch_size = 1024,
+                              size_t log_capacity = 1 << 16)
+        : queue{capacity}, batch_size{batch_size}, log_capacity{std::max(log_capacity, batch_size)} {
+        log.reserve(this->log_capacity);
+        full_log.reserve(this->log_capacity);
+    }
+    // Writes anything left in the log to the log stream, if there is one.
+    ~CommandProcessor() {
+        stop_log_writer();
+    }
+    CommandProcessor(const CommandProcessor&) = delete;
+    CommandProcessor& operator=(const CommandProcessor&) = delete;
+
+    // Nullptr, the default, keeps the log in memory until flush_log(). Must
+    // only be called from the consumer thread, and the stream must outlive
+    // the processor or be unset. Entries already logged go to the old stream.
+    void set_log_stream(std::ostream* os) {
+        stop_log_writer();
+        log_stream = os;
+        if(os) {
+            log_writer = std::thread{&CommandProcessor::run_log_writer, this};
+        }
+    }
+
+#ifdef COMMAND_JOURNAL_SUPPORTED
+    // Replays the journal into accounts, creating any it mentions, then
+    // journals the commands processed from now on. Commands may only be
+    // submitted for the accounts in the map at this point. The journal and the
+    // map must outlive the processor. Call before submitting anything.
+    void attach_journal(CommandJournal& journal, std::unordered_map<uint32_t, BankAccount>& accounts) {
+        journal.replay(accounts);
+        account_ids.clear();
+        for(auto& [id, account] : accounts) {
+            account_ids.emplace(&account, id);
+        }
+        this->journal = &journal;
+    }
+#endif
+
+    bool try_submit(const BankAccountCommand& command) {
+        check_journalled(command);
+        return queue.try_push(command);
+    }
+    void submit(const BankAccountCommand& command) {
+        check_journalled(command);
+        queue.push(command);
+    }
+
+    // Executes up to one batch of commands and returns how many there were.
+    // Must only be called from the consumer thread.
+    size_t process() {
+        size_t count = queue.consume([this](BankAccountCommand& command) {
+            command.call();
+#ifdef COMMAND_JOURNAL_SUPPORTED
+            if(journal && command.get_succeeded()) {
+                journal->append(account_ids.at(&command.get_account()), command);
+            }
+#endif
+            if(log.size() < log_capacity) {
+                log.push_back({command.action, command.get_amount(),
+                               command.get_account().get_balance(),
+                               command.get_succeeded()});
+            } else {
+                ++log_dropped;
+            }
+        }, batch_size);
+        // Handed off before it can overflow, as a batch always fits.
+        if(log_stream && log.size() + batch_size > log_capacity) {
+            hand_off_log();
+        }
+#ifdef COMMAND_JOURNAL_SUPPORTED
+        if(journal && count < batch_size) {
+            journal->commit();
+        }
+#endif
+        processed.fetch_add(count, std::memory_order_release);
+        return count;
+    }
+    size_t get_processed() const {
+        return processed.load(std::memory_order_acquire);
+    }
+    // Entries that didn't fit in the log. Consumer thread only.
+    size_t get_log_dropped() const {
+        return log_dropped;
+    }
+
+    // Writes and clears the log, after waiting for the writer thread to write
+    // what it's been given. Must only be called from the consumer thread, or
+    // once it has stopped.
+    void flush_log(std::ostream& os) {
+        {
+            std::unique_lock lock{log_mutex};
+            log_idle.wait(lock, [this]() { return full_log.empty() && !log_writing; });
+        }
+        write_log(os, log);
+        log.clear();
+    }
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <variant>
+#include <vector>
+#include "BankAccount.h"
+
+// Value semantic alternative to the BankAccountCommand hierarchy. Commands are
+// plain structs that refer to accounts by index, so a log of them is stored
+// contiguously with no allocation per command, and executing one is a
+// std::visit the compiler can inline rather than a virtual call.
+struct DepositCommand {
+    uint32_t account;
+    int amount;
+};
+struct WithdrawCommand {
+    uint32_t account;
+    int amount;
+};
+struct TransferCommand {
+    uint32_t from;
+    uint32_t to;
+    int amount;
+};
+
+using AccountCommand = std::variant<DepositCommand, WithdrawCommand, TransferCommand>;
+
+class AccountCommandExecutor {
+    std::vector<BankAccount>& accounts;
+public:
+    explicit AccountCommandExecutor(std::vector<BankAccount>& accounts)
+        : accounts(accounts) {}
+
+    // Each returns whether the command succeeded.
+    bool operator()(const DepositCommand& command) {
+        accounts[command.account].deposit(command.amount);
+        return true;
+    }
+    bool operator()(const WithdrawCommand& command) {
+        return accounts[command.account].withdraw(command.amount);
+    }
+    bool operator()(const TransferCommand& command) {
+        if(!accounts[command.from].withdraw(command.amount)) {
+            return false;
+        }
+        accounts[command.to].deposit(command.amount);
+        return true;
+    }
+
+    bool execute(const AccountCommand& command) {
+        return std::visit(*this, command);
+    }
+    // Returns how many commands succeeded.
+    size_t execute(const std::vector<AccountCommand>& commands) {
+        size_t succeeded{};
+        for(const auto& command : commands) {
+            succeeded += execute(command);
+        }
+        return succeeded;
+    }
+};
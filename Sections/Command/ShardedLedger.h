@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "BankAccount.h"
+#include "CommandQueue.h"
+
+// Bank accounts partitioned into shards, each owned by one worker thread.
+// Commands are routed to the shard that owns their account, so commands for
+// different shards run in parallel, while the commands for any one account
+// are executed in the order they were submitted.
+// A transfer between shards takes two phases: the source shard withdraws the
+// money and, only if that succeeded, forwards a deposit to the target shard.
+// So a failed transfer never touches the target account.
+// A worker with nothing to do spins briefly, then sleeps until something is
+// pushed to its queue, so an idle ledger doesn't keep its cores busy.
+class ShardedLedger {
+public:
+    using AccountId = uint32_t;
+private:
+    struct Message {
+        enum class Type {deposit, withdraw, transfer_withdraw, transfer_deposit} type;
+        AccountId account;
+        AccountId target; // Transfers only.
+        int amount;
+    };
+    struct Shard {
+        MpscQueue<Message> queue;
+        std::unordered_map<AccountId, BankAccount> accounts; // Worker only.
+        std::deque<Message> outbox; // Deposits waiting for space in another shard's queue.
+        std::thread worker;
+        std::mutex mutex; // Only for sleeping and waking the worker.
+        std::condition_variable wake;
+        std::atomic<bool> sleeping{false};
+
+        explicit Shard(size_t capacity) : queue{capacity} {}
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> pending{}; // Submitted or forwarded, but not executed.
+    std::atomic<size_t> failed{};
+    std::atomic<bool> stopping{false};
+
+    Shard& shard_of(AccountId account) {
+        return *shards[account % shards.size()];
+    }
+    BankAccount& account_in(Shard& shard, AccountId id) {
+        auto it = shard.accounts.find(id);
+        if(it == shard.accounts.end()) {
+            it = shard.accounts.emplace(id, BankAccount{}).first;
+            it->second.set_logging(false);
+        }
+        return it->second;
+    }
+    // Called after pushing to the shard's queue.
+    void wake(Shard& shard) {
+        // Orders the push before the check, the worker does the reverse, so
+        // either it sees the message or it's seen to be sleeping.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(shard.sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard lock{shard.mutex};
+            shard.wake.notify_one();
+        }
+    }
+    void sleep(Shard& shard) {
+        std::unique_lock lock{shard.mutex};
+        shard.sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        shard.wake.wait(lock, [&]() {
+            return stopping.load(std::memory_order_acquire) || shard.queue.ready();
+        });
+        shard.sleeping.store(false, std::memory_order_relaxed);
+    }
+    void submit(const Message& message) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        Shard& shard = shard_of(message.account);
+        shard.queue.push(message);
+        wake(shard);
+    }
+
+    void execute(Shard& shard, const Message& message) {
+        BankAccount& account = account_in(shard, message.account);
+        switch(message.type) {
+            case Message::Type::deposit:
+            case Message::Type::transfer_deposit: {
+                account.deposit(message.amount);
+                break;
+            }
+            case Message::Type::withdraw: {
+                if(!account.withdraw(message.amount)) {
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            }
+            case Message::Type::transfer_withdraw: {
+                if(!account.withdraw(message.amount)) {
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+                Message deposit{Message::Type::transfer_deposit, message.target,
+                                message.target, message.amount};
+                Shard& target = shard_of(message.target);
+                if(&target == &shard) {
+                    account_in(shard, message.target).deposit(message.amount);
+                } else {
+                    // Counted before this message is, so pending never drops to 0 early.
+                    pending.fetch_add(1, std::memory_order_relaxed);
+                    shard.outbox.push_back(deposit);
+                }
+                break;
+            }
+        }
+    }
+    void run(Shard& shard) {
+        size_t idle{}; // Passes in a row that found nothing to do.
+        while(!stopping.load(std::memory_order_acquire)) {
+            // Never block on a full queue, two shards could be waiting on each other.
+            while(!shard.outbox.empty()) {
+                Shard& target = shard_of(shard.outbox.front().account);
+                if(!target.queue.try_push(shard.outbox.front())) {
+                    break;
+                }
+                shard.outbox.pop_front();
+                wake(target);
+            }
+            size_t count = shard.queue.consume([&](const Message& message) {
+                execute(shard, message);
+            }, 1024);
+            pending.fetch_sub(count, std::memory_order_acq_rel);
+            if(count != 0) {
+                idle = 0;
+            } else if(!shard.outbox.empty() || ++idle < 64) {
+                std::this_thread::yield();
+            } else {
+                sleep(shard);
+                idle = 0;
+            }
+        }
+    }
+public:
+    explicit ShardedLedger(size_t shard_count = std::thread::hardware_concurrency(),
+                           size_t queue_capacity = 1 << 16) {
+        shard_count = std::max<size_t>(shard_count, 1);
+        for(size_t i{}; i < shard_count; ++i) {
+            shards.push_back(std::make_unique<Shard>(queue_capacity));
+        }
+        for(auto& shard : shards) {
+            shard->worker = std::thread{&ShardedLedger::run, this, std::ref(*shard)};
+        }
+    }
+    // Executes everything already submitted, including deposits still waiting
+    // in an outbox, before stopping the workers. Nothing may be submitted
+    // once destruction has started.
+    ~ShardedLedger() {
+        wait();
+        stopping.store(true, std::memory_order_release);
+        for(auto& shard : shards) {
+            {
+                std::lock_guard lock{shard->mutex};
+                shard->wake.notify_one();
+            }
+            shard->worker.join();
+        }
+    }
+    ShardedLedger(const ShardedLedger&) = delete;
+    ShardedLedger& operator=(const ShardedLedger&) = delete;
+
+    // Safe to call from any thread.
+    void deposit(AccountId account, int amount) {
+        submit({Message::Type::deposit, account, account, amount});
+    }
+    void withdraw(AccountId account, int amount) {
+        submit({Message::Type::withdraw, account, account, amount});
+    }
+    void transfer(AccountId from, AccountId to, int amount) {
+        submit({Message::Type::transfer_withdraw, from, to, amount});
+    }
+
+    // Waits until every submitted command, including both phases of
+    // transfers, has been executed.
+    void wait() const {
+        while(pending.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+    size_t get_failed() const {
+        return failed.load(std::memory_order_relaxed);
+    }
+    size_t get_shard_count() const {
+        return shards.size();
+    }
+    // Only call once wait() has returned and nothing else is being submitted.
+    int get_balance(AccountId account) {
+        auto& accounts = shard_of(account).accounts;
+        auto it = accounts.find(account);
+        return it == accounts.end() ? 0 : it->second.get_balance();
+    }
+};
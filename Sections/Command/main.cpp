@@ -1,153 +1,373 @@
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <random>
+#include "Command.h"
+#include "CommandQueue.h"
+#include "ShardedLedger.h"
+#include "CommandVariant.h"
+#include "CommandJournal.h"
+#include <filesystem>
 
-class BankAccount {
-    int balance{};
-    int overdraft_limit{-500};
-public:
-    void deposit(int amount) {
-        balance += amount;
-        std::cout << "Deposited: " << amount
-                    << ", balance is: " << balance << std::endl;
-    }
-    bool withdraw(int amount) {
-        if(balance-amount >= overdraft_limit) {
-            balance -= amount;
-            std::cout << "Withdrew: " << amount
-                        << ", balance is: " << balance << std::endl;
-            return true;
-        }
-        return false;
+void process_transactions() {
+    BankAccount account;
+    std::vector<BankAccountCommand> commands {
+            {account, BankAccountCommand::Action::deposit, 100},
+            {account, BankAccountCommand::Action::withdraw, 200}
+    };
+    for(BankAccountCommand& command : commands) {
+        command.call();
     }
-};
+    for(auto it = commands.rbegin(); it != commands.rend(); ++it) {
+        it->undo();
+    }
+    std::cout << std::endl;
+}
 
-class Command {
-public:
-    virtual ~Command() = default;
-    virtual void call() = 0;
-    virtual void undo() = 0;
-};
+void bank_transfer() {
+    BankAccount account1, account2;
+    account1.deposit(100);
+    MoneyTransferCommand cmd{account1, account2, 50};
+    cmd.call();
+    cmd.undo();
+}
 
-class BankAccountCommand : public Command {
-    BankAccount& account;
-    int amount;
-    bool succeeded;
-public:
-    enum class Action {deposit, withdraw} action;
+void failed_transfer() {
+    BankAccount account1, account2;
+    // The deposit succeeds but the withdrawal exceeds the overdraft limit,
+    // so the deposit is undone too.
+    DependantCompositeCommand cmd{{account2, BankAccountCommand::Action::deposit, 100},
+                                  {account1, BankAccountCommand::Action::withdraw, 1000}};
+    cmd.call();
+    std::cout << "Transfer succeeded: " << std::boolalpha << cmd.get_succeeded()
+              << ", balances: " << account1.get_balance() << ", "
+              << account2.get_balance() << std::endl;
+}
 
-    BankAccountCommand(BankAccount &account, Action action, int amount)
-        : account(account), action(action), amount(amount) {}
+void undo_spent_deposit() {
+    BankAccount account;
+    BankAccountCommand deposit{account, BankAccountCommand::Action::deposit, 100};
+    deposit.call();
+    account.withdraw(550);
+    // Taking the deposit back would go past the overdraft limit.
+    std::cout << "Undid spent deposit: " << std::boolalpha << deposit.undo()
+              << ", balance: " << account.get_balance() << std::endl;
+}
 
-    bool get_succeeded() const {
-        return succeeded;
-    }
-    void set_succeeded(bool succeeded) {
-        this->succeeded = succeeded;
+void large_rollback() {
+    using namespace std::chrono;
+    BankAccount account;
+    account.set_logging(false);
+    std::vector<BankAccountCommand> commands;
+    for(int i{}; i < 1'000'000; ++i) {
+        commands.emplace_back(account, BankAccountCommand::Action::deposit, 1);
     }
+    CompositeBankAccountCommand batch{std::move(commands)};
+    batch.call();
+    auto start = steady_clock::now();
+    batch.undo();
+    auto time = duration_cast<milliseconds>(steady_clock::now() - start);
+    std::cout << "Rolled back 1000000 deposits in " << time.count()
+              << "ms, balance is: " << account.get_balance() << std::endl;
+}
 
-    void call() override {
-        switch(action) {
-            case Action::deposit: {
-                account.deposit(amount);
-                succeeded = true;
-                break;
-            }
-            case Action::withdraw: {
-                succeeded = account.withdraw(amount);
-                break;
+void batched_processing() {
+    using namespace std::chrono;
+    const size_t producers{4}, commands_per_producer{1'000'000};
+    BankAccount account;
+    account.set_logging(false);
+    CommandProcessor processor;
+    // Formatted and written on the processor's writer thread whenever its log fills up.
+    std::ostringstream log;
+    processor.set_log_stream(&log);
+
+    auto start = steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t p{}; p < producers; ++p) {
+        threads.emplace_back([&]() {
+            for(size_t i{}; i < commands_per_producer; ++i) {
+                auto action = i % 2 ? BankAccountCommand::Action::withdraw
+                                    : BankAccountCommand::Action::deposit;
+                processor.submit({account, action, 10});
             }
-        }
+        });
     }
-    void undo() override {
-        if(!succeeded) {
-            return;
-        }
-        switch(action) {
-            case Action::deposit: {
-                account.withdraw(amount);
-            }
-            case Action::withdraw: {
-                account.deposit(amount);
-            }
+    const size_t total{producers * commands_per_producer};
+    while(processor.get_processed() < total) {
+        if(processor.process() == 0) {
+            std::this_thread::yield();
         }
     }
-};
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    auto time = duration_cast<milliseconds>(steady_clock::now() - start);
 
-class CompositeBankAccountCommand : public Command {
-    std::vector<BankAccountCommand> commands;
-public:
-    CompositeBankAccountCommand(std::initializer_list<BankAccountCommand> commands)
-        : commands{commands} {}
+    processor.flush_log(log);
+    std::cout << "Processed " << total << " commands from " << producers
+              << " threads in " << time.count() << "ms ("
+              << total * 1000 / std::max<long long>(time.count(), 1) << " per second)" << std::endl
+              << "Final balance: " << account.get_balance()
+              << ", log size: " << log.str().size() << " bytes" << std::endl;
+}
 
-    auto& get_commands() {
-        return commands;
+void sharded_ledger() {
+    using namespace std::chrono;
+    const size_t producers{4}, commands_per_producer{500'000};
+    const ShardedLedger::AccountId accounts{1000};
+    ShardedLedger ledger{4};
+
+    auto start = steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t p{}; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            std::mt19937 random(p);
+            std::uniform_int_distribution<ShardedLedger::AccountId> pick{0, accounts - 1};
+            for(size_t i{}; i < commands_per_producer; ++i) {
+                if(i % 2) {
+                    ledger.transfer(pick(random), pick(random), 10);
+                } else {
+                    ledger.deposit(pick(random), 10);
+                }
+            }
+        });
     }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    ledger.wait();
+    auto time = duration_cast<milliseconds>(steady_clock::now() - start);
 
-    void call() override {
-        for(BankAccountCommand& command : commands) {
-            command.call();
-        }
+    // Transfers move money between accounts, so only deposits change the total.
+    long long total{};
+    for(ShardedLedger::AccountId account{}; account < accounts; ++account) {
+        total += ledger.get_balance(account);
     }
-    void undo() override {
-        for(auto it{commands.rbegin()}; it != commands.rend(); ++it) {
-            for(auto it = commands.rbegin(); it != commands.rend(); ++it) {
-                it->undo();
-            }
+    const size_t commands{producers * commands_per_producer};
+    std::cout << "Processed " << commands << " commands on " << ledger.get_shard_count()
+              << " shards in " << time.count() << "ms" << std::endl
+              << "Failed: " << ledger.get_failed() << ", money conserved: " << std::boolalpha
+              << (total == static_cast<long long>(commands / 2 * 10)) << std::endl;
+}
+
+// Only meaningful in an optimised build, std::visit isn't inlined without one.
+void variant_commands() {
+    using namespace std::chrono;
+    const size_t command_count{10'000'000};
+    const uint32_t account_count{1000};
+    auto make_accounts = [&]() {
+        std::vector<BankAccount> accounts(account_count);
+        for(auto& account : accounts) {
+            account.set_logging(false);
+        }
+        return accounts;
+    };
+    // The same random sequence of deposits and withdrawals for both.
+    auto for_each_command = [&](auto&& func) {
+        std::mt19937 random;
+        std::uniform_int_distribution<uint32_t> pick{0, account_count - 1};
+        for(size_t i{}; i < command_count; ++i) {
+            func(pick(random), i % 3 != 0, static_cast<int>(i % 100));
+        }
+    };
+
+    // Virtual hierarchy, one heap allocation per command.
+    auto virtual_accounts = make_accounts();
+    long long virtual_time;
+    {
+        std::vector<std::unique_ptr<Command>> commands;
+        commands.reserve(command_count);
+        for_each_command([&](uint32_t account, bool deposit, int amount) {
+            auto action = deposit ? BankAccountCommand::Action::deposit
+                                  : BankAccountCommand::Action::withdraw;
+            commands.push_back(std::make_unique<BankAccountCommand>(
+                    virtual_accounts[account], action, amount));
+        });
+        auto start = steady_clock::now();
+        for(auto& command : commands) {
+            command->call();
         }
+        virtual_time = duration_cast<milliseconds>(steady_clock::now() - start).count();
     }
-};
 
-class DependantCompositeCommand : public CompositeBankAccountCommand {
-public:
-    DependantCompositeCommand(const std::initializer_list<BankAccountCommand> &commands)
-        : CompositeBankAccountCommand(commands) {}
-
-    void call() override {
-        bool ok{true};
-        for(auto& command : get_commands()) {
-            if(ok) {
-                command.call();
-                ok = command.get_succeeded();
+    // Variant, stored contiguously.
+    auto variant_accounts = make_accounts();
+    long long variant_time;
+    {
+        std::vector<AccountCommand> commands;
+        commands.reserve(command_count);
+        for_each_command([&](uint32_t account, bool deposit, int amount) {
+            if(deposit) {
+                commands.emplace_back(DepositCommand{account, amount});
             } else {
-                command.set_succeeded(false);
+                commands.emplace_back(WithdrawCommand{account, amount});
             }
-        }
+        });
+        AccountCommandExecutor executor{variant_accounts};
+        auto start = steady_clock::now();
+        executor.execute(commands);
+        variant_time = duration_cast<milliseconds>(steady_clock::now() - start).count();
     }
-};
 
-class MoneyTransferCommand : public DependantCompositeCommand {
-public:
-    MoneyTransferCommand(BankAccount& from, BankAccount& to, int amount)
-        : DependantCompositeCommand{{from, BankAccountCommand::Action::withdraw, amount},
-                                    {to, BankAccountCommand::Action::deposit, amount}} {}
-};
+    bool match{true};
+    for(uint32_t i{}; i < account_count; ++i) {
+        match = match && virtual_accounts[i].get_balance() == variant_accounts[i].get_balance();
+    }
+    std::cout << "Executing " << command_count << " commands:" << std::endl
+              << "  Virtual (" << sizeof(BankAccountCommand) << " bytes + allocation each): "
+              << virtual_time << "ms" << std::endl
+              << "  Variant (" << sizeof(AccountCommand) << " bytes each): "
+              << variant_time << "ms" << std::endl
+              << "  Balances match: " << std::boolalpha << match << std::endl;
+#ifndef NDEBUG
+    std::cout << "  Not an optimised build, the timings aren't representative" << std::endl;
+#endif
+}
 
-void process_transactions() {
-    BankAccount account;
-    std::vector<BankAccountCommand> commands {
-            {account, BankAccountCommand::Action::deposit, 100},
-            {account, BankAccountCommand::Action::withdraw, 200}
-    };
-    for(BankAccountCommand& command : commands) {
-        command.call();
+void command_journal() {
+#ifdef COMMAND_JOURNAL_SUPPORTED
+    using namespace std::chrono;
+    auto path = (std::filesystem::temp_directory_path() / "bank.journal").string();
+    std::filesystem::remove(path);
+    const uint32_t account_count{100};
+    const size_t command_count{1'000'000};
+
+    std::unordered_map<uint32_t, BankAccount> accounts;
+    for(uint32_t id{}; id < account_count; ++id) {
+        accounts[id].set_logging(false);
     }
-    for(auto it = commands.rbegin(); it != commands.rend(); ++it) {
-        it->undo();
+    {
+        CommandJournal journal{path};
+        CommandProcessor processor;
+        processor.attach_journal(journal, accounts); // Nothing to recover yet.
+        auto start = steady_clock::now();
+        std::thread producer([&]() {
+            for(size_t i{}; i < command_count; ++i) {
+                auto action = i % 3 ? BankAccountCommand::Action::deposit
+                                    : BankAccountCommand::Action::withdraw;
+                processor.submit({accounts.at(static_cast<uint32_t>(i % account_count)),
+                                  action, static_cast<int>(i % 50)});
+            }
+        });
+        while(processor.get_processed() < command_count) {
+            if(processor.process() == 0) {
+                std::this_thread::yield();
+            }
+        }
+        producer.join();
+        journal.commit();
+        auto time = duration_cast<milliseconds>(steady_clock::now() - start);
+        std::cout << "Processed " << command_count << " commands, journalling " << journal.size()
+                  << " in " << time.count() << "ms" << std::endl;
+    } // Closed, as if the program had stopped.
+
+    // Start up again, recovering the balances from the journal.
+    CommandJournal journal{path};
+    std::unordered_map<uint32_t, BankAccount> replayed;
+    CommandProcessor processor;
+    auto start = steady_clock::now();
+    processor.attach_journal(journal, replayed);
+    auto time = duration_cast<microseconds>(steady_clock::now() - start);
+    bool match{true};
+    for(auto& [id, account] : accounts) {
+        match = match && replayed[id].get_balance() == account.get_balance();
     }
-    std::cout << std::endl;
+    double megabytes = journal.size() * sizeof(CommandJournal::Record) / 1e6;
+    std::cout << "Recovered from " << megabytes << "MB in " << time.count() / 1000 << "ms ("
+              << megabytes / std::max(time.count() / 1e6, 1e-6) << "MB/s)" << std::endl
+              << "Balances match: " << std::boolalpha << match << std::endl;
+
+    // Undo the last command from before the restart.
+    const auto& last = journal[journal.last_undoable()];
+    auto& account = replayed[last.account];
+    std::cout << "Account " << last.account << " before undo: " << account.get_balance();
+    BankAccountCommand command{account, static_cast<BankAccountCommand::Action>(last.action),
+                               last.amount};
+    command.set_succeeded(true);
+    if(command.undo()) {
+        journal.append(last.account, command, true);
+        std::cout << ", after: " << account.get_balance() << std::endl;
+    } else {
+        std::cout << ", can't be undone as it would exceed the overdraft limit" << std::endl;
+    }
+    std::filesystem::remove(path);
+#else
+    std::cout << "The command journal isn't supported on this platform." << std::endl;
+#endif
 }
 
-void bank_transfer() {
-    BankAccount account1, account2;
-    account1.deposit(100);
-    MoneyTransferCommand cmd{account1, account2, 50};
-    cmd.call();
-    cmd.undo();
+void concurrent_transfers() {
+    using namespace std::chrono;
+    const size_t thread_count{4}, transfers_per_thread{250'000};
+    const int account_count{64}, initial_balance{1000};
+
+    // Fraction of transfers that involve account 0.
+    for(double skew : {0.0, 0.5, 0.9}) {
+        std::vector<BankAccount> accounts(account_count);
+        for(auto& account : accounts) {
+            account.set_logging(false);
+            account.deposit(initial_balance);
+        }
+        std::atomic<size_t> failed{};
+        auto start = steady_clock::now();
+        std::vector<std::thread> threads;
+        for(size_t t{}; t < thread_count; ++t) {
+            threads.emplace_back([&, t]() {
+                std::mt19937 random(t);
+                std::uniform_int_distribution<int> pick{0, account_count - 1};
+                std::bernoulli_distribution hot{skew};
+                for(size_t i{}; i < transfers_per_thread; ++i) {
+                    int from = pick(random), to = pick(random);
+                    if(hot(random)) {
+                        (i % 2 ? from : to) = 0;
+                    }
+                    MoneyTransferCommand transfer{accounts[from], accounts[to], 1 + pick(random)};
+                    transfer.call();
+                    if(!transfer.get_succeeded()) {
+                        failed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        auto time = duration_cast<milliseconds>(steady_clock::now() - start);
+
+        long long total{};
+        bool within_limit{true};
+        for(auto& account : accounts) {
+            total += account.get_balance();
+            within_limit = within_limit && account.get_balance() >= -500;
+        }
+        std::cout << "Hot account skew " << skew << ": " << thread_count * transfers_per_thread
+                  << " transfers on " << thread_count << " threads in " << time.count() << "ms, "
+                  << failed << " failed" << std::endl
+                  << "  Money conserved: " << std::boolalpha
+                  << (total == account_count * initial_balance)
+                  << ", overdraft limit respected: " << within_limit << std::endl;
+    }
 }
 
 int main() {
     process_transactions();
     bank_transfer();
+    std::cout << std::endl;
+    failed_transfer();
+    undo_spent_deposit();
+    large_rollback();
+    std::cout << std::endl;
+    batched_processing();
+    std::cout << std::endl;
+    sharded_ledger();
+    std::cout << std::endl;
+    variant_commands();
+    std::cout << std::endl;
+    command_journal();
+    std::cout << std::endl;
+    concurrent_transfers();
 
     return 0;
 }
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory_resource>
+#include "Expression.h"
+
+// An expression whose elements all live in a single arena owned by this
+// object. Parsing a large expression doesn't make an allocation per element,
+// and destroying it frees the arena in one go.
+class CompiledExpression {
+    std::string text;
+    std::pmr::monotonic_buffer_resource arena;
+    const Element* root; // The arena owns the elements.
+
+    const Element* parse_into_arena(const std::vector<Token>& tokens) {
+        Parser::ArenaNodes nodes{&arena};
+        return Parser::parse(tokens, 0, tokens.size(), nodes);
+    }
+
+    CompiledExpression(const std::string& text, const std::vector<Token>& tokens)
+        : text{text},
+          // Each token creates at most one element, so usually one block is enough.
+          arena{tokens.size() * sizeof(ArenaOperation) + sizeof(Integer)},
+          root{parse_into_arena(tokens)} {}
+public:
+    explicit CompiledExpression(const std::string& text)
+        : CompiledExpression{text, lex(text)} {}
+
+    CompiledExpression(const CompiledExpression&) = delete;
+    CompiledExpression& operator=(const CompiledExpression&) = delete;
+
+    const std::string& get_text() const {
+        return text;
+    }
+    const Element& get_root() const {
+        return *root;
+    }
+
+    int eval(const Variables& variables = {}) const {
+        return root->eval(variables);
+    }
+    void eval_batch(const Columns& columns, size_t rows, int* out) const {
+        ::eval_batch(*root, columns, rows, out);
+    }
+};
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <memory>
+#include <memory_resource>
+#include <map>
+#include <unordered_map>
+#include <cctype>
+#include <stdexcept>
+#include <algorithm>
+
+// Single letter variables bound to values, e.g. {{'x', 5}}.
+using Variables = std::map<char, int>;
+// Single letter variables bound to columns of values for batch evaluation.
+// Every column must have at least as many rows as are being evaluated.
+using Columns = std::map<char, const int*>;
+
+// Rows evaluated per pass over the expression during batch evaluation. Small
+// enough for the intermediate blocks to stay in L1 cache.
+constexpr size_t block_size{256};
+
+class Token {
+public:
+    friend std::ostream& operator<<(std::ostream& os, const Token& token) {
+        os << '\'' << token.text << '\'';
+        return os;
+    }
+
+    enum Type {integer, variable, plus, minus, lparen, rparen} type;
+    std::string text;
+
+    Token(Type type, const std::string& text)
+            : type{type}, text{text} {}
+};
+
+class Element {
+public:
+    virtual ~Element() = default;
+
+    virtual int eval(const Variables& variables) const = 0;
+
+    int eval() const {
+        return eval(Variables{});
+    }
+};
+class Integer : public Element {
+    int value;
+public:
+    using Element::eval;
+
+    Integer(int value) : value(value) {}
+
+    int get_value() const {
+        return value;
+    }
+
+    int eval(const Variables&) const override {
+        return value;
+    }
+};
+class Variable : public Element {
+    char name;
+public:
+    using Element::eval;
+
+    Variable(char name) : name(name) {}
+
+    char get_name() const {
+        return name;
+    }
+
+    int eval(const Variables& variables) const override {
+        return variables.at(name);
+    }
+};
+// Operation on two operands, whose links to them are up to the subclass.
+class Operation : public Element {
+public:
+    enum Type {addition, subtraction} type;
+
+    virtual const Element& get_lhs() const = 0;
+    virtual const Element& get_rhs() const = 0;
+
+    static int apply(Type type, int left, int right) {
+        return type == addition ? left + right : left - right;
+    }
+};
+// Owns its operands, for expressions on the heap.
+class BinaryOperation : public Operation {
+public:
+    using Element::eval;
+
+    std::shared_ptr<Element> lhs, rhs;
+
+    const Element& get_lhs() const override {
+        return *lhs;
+    }
+    const Element& get_rhs() const override {
+        return *rhs;
+    }
+    int eval(const Variables& variables) const override {
+        return apply(type, lhs->eval(variables), rhs->eval(variables));
+    }
+};
+// Points to its operands without owning them, for expressions in an arena,
+// where the arena owns every node. See CompiledExpression.
+class ArenaOperation : public Operation {
+public:
+    using Element::eval;
+
+    const Element* lhs{};
+    const Element* rhs{};
+
+    const Element& get_lhs() const override {
+        return *lhs;
+    }
+    const Element& get_rhs() const override {
+        return *rhs;
+    }
+    int eval(const Variables& variables) const override {
+        return apply(type, lhs->eval(variables), rhs->eval(variables));
+    }
+};
+
+// One node of an expression flattened by flatten().
+struct Step {
+    enum Kind {integer, variable, operation} kind;
+    int value; // Integer.
+    char name; // Variable.
+    Operation::Type type; // Operation, with the positions of its operands.
+    size_t lhs, rhs;
+};
+// Lists the distinct nodes of an expression with children before their
+// parents, so the root is last. Shared nodes are listed once. Walks the tree
+// with an explicit stack, so deep expressions don't use up the call stack.
+inline std::vector<Step> flatten(const Element& root) {
+    std::vector<Step> steps;
+    std::unordered_map<const Element*, size_t> positions;
+    std::vector<std::pair<const Element*, bool>> pending{{&root, false}}; // Node, operands listed.
+    while(!pending.empty()) {
+        auto [element, operands_listed] = pending.back();
+        pending.pop_back();
+        if(positions.count(element) != 0) {
+            continue;
+        }
+        Step step{};
+        if(auto integer = dynamic_cast<const Integer*>(element)) {
+            step.kind = Step::integer;
+            step.value = integer->get_value();
+        } else if(auto variable = dynamic_cast<const Variable*>(element)) {
+            step.kind = Step::variable;
+            step.name = variable->get_name();
+        } else {
+            auto& operation = dynamic_cast<const Operation&>(*element);
+            if(!operands_listed) {
+                pending.push_back({element, true});
+                pending.push_back({&operation.get_rhs(), false});
+                pending.push_back({&operation.get_lhs(), false});
+                continue;
+            }
+            step.kind = Step::operation;
+            step.type = operation.type;
+            step.lhs = positions.at(&operation.get_lhs());
+            step.rhs = positions.at(&operation.get_rhs());
+        }
+        positions.emplace(element, steps.size());
+        steps.push_back(step);
+    }
+    return steps;
+}
+
+// Whitespace is skipped, and any other character that isn't part of the
+// grammar is rejected rather than ignored, as StaticExpression does.
+inline std::vector<Token> lex(const std::string& exp) { // Lexing/tokenisation converts a string into a token.
+    std::vector<Token> result;
+    for(size_t i{}; i < exp.size(); ++i) {
+        switch(exp[i]) {
+            case '+': {
+                result.emplace_back(Token::plus, "+");
+                break;
+            }
+            case '-': {
+                result.emplace_back(Token::minus, "-");
+                break;
+            }
+            case '(': {
+                result.emplace_back(Token::lparen, "(");
+                break;
+            }
+            case ')': {
+                result.emplace_back(Token::rparen, ")");
+                break;
+            }
+            default: {
+                if(std::isalpha(exp[i])) {
+                    result.emplace_back(Token::variable, std::string(1, exp[i]));
+                } else if(std::isdigit(exp[i])) {
+                    std::ostringstream buffer;
+                    buffer << exp[i];
+                    for(i += 1; i < exp.size() && std::isdigit(exp[i]); ++i) {
+                        buffer << exp[i];
+                    }
+                    result.emplace_back(Token::integer, buffer.str());
+                    i -= 1;
+                } else if(!std::isspace(exp[i])) {
+                    throw std::runtime_error(std::string("Unexpected character: ") + exp[i]);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+class CompiledExpression;
+inline std::shared_ptr<Element> parse(const std::vector<Token>& tokens);
+
+// Parses on behalf of parse(), which puts the nodes on the heap linked by
+// shared_ptrs, and CompiledExpression, which puts them in its arena linked by
+// plain pointers. Arena nodes are never destroyed individually, the arena
+// releases all of their memory at once, and nothing in them owns anything.
+// Pointers to them dangle once the arena is gone, so parsing into an arena is
+// private to the class that owns it.
+class Parser {
+    friend class CompiledExpression;
+    friend std::shared_ptr<Element> parse(const std::vector<Token>& tokens);
+
+    struct HeapNodes {
+        using Link = std::shared_ptr<Element>;
+        using Operation = BinaryOperation;
+        using OperationLink = std::shared_ptr<BinaryOperation>;
+
+        template <typename T, typename... Args>
+        std::shared_ptr<T> make(Args&&... args) {
+            return std::make_shared<T>(std::forward<Args>(args)...);
+        }
+    };
+    struct ArenaNodes {
+        using Link = const Element*;
+        using Operation = ArenaOperation;
+        using OperationLink = ArenaOperation*;
+
+        std::pmr::memory_resource* arena;
+
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            std::pmr::polymorphic_allocator<T> allocator{arena};
+            T* element = allocator.allocate(1);
+            allocator.construct(element, std::forward<Args>(args)...);
+            return element;
+        }
+    };
+
+    // Parses tokens [begin, end).
+    // Operations are left associative, so "1-2+3" is parsed as "(1-2)+3".
+    template <typename Nodes>
+    static typename Nodes::Link parse(const std::vector<Token>& tokens, size_t begin,
+                                      size_t end, Nodes& nodes) {
+        typename Nodes::Link result{};
+        typename Nodes::OperationLink operation{}; // Waiting for its rhs.
+        auto add_operand = [&](typename Nodes::Link element) {
+            if(!result) {
+                result = std::move(element);
+            } else if(operation && !operation->rhs) {
+                operation->rhs = std::move(element);
+                result = std::move(operation);
+                operation = nullptr;
+            } else {
+                throw std::runtime_error("Missing operator");
+            }
+        };
+        auto add_operator = [&](BinaryOperation::Type type) {
+            if(!result || operation) {
+                throw std::runtime_error("Missing operand");
+            }
+            operation = nodes.template make<typename Nodes::Operation>();
+            operation->lhs = result;
+            operation->type = type;
+        };
+        for(size_t i{begin}; i < end; ++i) {
+            auto& token {tokens[i]};
+            switch(token.type) {
+                case Token::integer: {
+                    add_operand(nodes.template make<Integer>(std::stoi(token.text)));
+                    break;
+                }
+                case Token::variable: {
+                    add_operand(nodes.template make<Variable>(token.text[0]));
+                    break;
+                }
+                case Token::plus: {
+                    add_operator(BinaryOperation::addition);
+                    break;
+                }
+                case Token::minus: {
+                    add_operator(BinaryOperation::subtraction);
+                    break;
+                }
+                case Token::lparen: {
+                    size_t j = i + 1;
+                    for(int depth{1}; j < end; ++j) {
+                        if(tokens[j].type == Token::lparen) {
+                            ++depth;
+                        } else if(tokens[j].type == Token::rparen && --depth == 0) {
+                            break;
+                        }
+                    }
+                    if(j == end) {
+                        throw std::runtime_error("Missing ')'");
+                    }
+                    add_operand(parse(tokens, i+1, j, nodes));
+                    i = j;
+                    break;
+                }
+                case Token::rparen: {
+                    throw std::runtime_error("Unexpected ')'");
+                }
+            }
+        }
+        if(!result || operation) {
+            throw std::runtime_error("Missing operand");
+        }
+        return result;
+    }
+};
+inline std::shared_ptr<Element> parse(const std::vector<Token>& tokens) {
+    Parser::HeapNodes nodes;
+    return Parser::parse(tokens, 0, tokens.size(), nodes);
+}
+
+// Evaluates the expression for each of the rows of the columns, writing the
+// results to out. Rather than calling eval() once per row, the flattened
+// expression is worked through once per block of rows, and the loops over a
+// block can be vectorised. Each step's block of results goes in a slot of a
+// heap allocated scratch buffer, and a slot is reused once the step's parent
+// has read it, so the buffer stays small however deep the expression is.
+inline void eval_batch(const Element& expression, const Columns& columns,
+                       size_t rows, int* out) {
+    auto steps = flatten(expression);
+    std::vector<size_t> last_use(steps.size(), steps.size()); // By the root, never.
+    for(size_t i{}; i < steps.size(); ++i) {
+        if(steps[i].kind == Step::operation) {
+            last_use[steps[i].lhs] = i;
+            last_use[steps[i].rhs] = i;
+        }
+    }
+    std::vector<size_t> slots(steps.size()), free_slots;
+    size_t slot_count{};
+    for(size_t i{}; i < steps.size(); ++i) {
+        const Step& step = steps[i];
+        // Operands are freed first, so the result can overwrite one of them.
+        if(step.kind == Step::operation) {
+            if(last_use[step.lhs] == i) {
+                free_slots.push_back(slots[step.lhs]);
+            }
+            if(last_use[step.rhs] == i && step.rhs != step.lhs) {
+                free_slots.push_back(slots[step.rhs]);
+            }
+        }
+        if(free_slots.empty()) {
+            slots[i] = slot_count++;
+        } else {
+            slots[i] = free_slots.back();
+            free_slots.pop_back();
+        }
+    }
+
+    std::vector<int> scratch(slot_count * block_size);
+    auto block = [&](size_t step) {
+        return scratch.data() + slots[step] * block_size;
+    };
+    for(size_t offset{}; offset < rows; offset += block_size) {
+        size_t count = std::min(block_size, rows - offset);
+        for(size_t i{}; i < steps.size(); ++i) {
+            const Step& step = steps[i];
+            int* result = block(i);
+            switch(step.kind) {
+                case Step::integer: {
+                    std::fill_n(result, count, step.value);
+                    break;
+                }
+                case Step::variable: {
+                    std::copy_n(columns.at(step.name) + offset, count, result);
+                    break;
+                }
+                case Step::operation: {
+                    const int* left = block(step.lhs);
+                    const int* right = block(step.rhs);
+                    if(step.type == Operation::addition) {
+                        for(size_t j{}; j < count; ++j) {
+                            result[j] = left[j] + right[j];
+                        }
+                    } else {
+                        for(size_t j{}; j < count; ++j) {
+                            result[j] = left[j] - right[j];
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+        std::copy_n(block(steps.size() - 1), count, out + offset);
+    }
+}
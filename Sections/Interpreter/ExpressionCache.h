@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include "CompiledExpression.h"
+
+// Maps expression text to its compiled form, so an expression that's
+// evaluated repeatedly is only lexed and parsed once. Lookups hash the text
+// and then compare it in full.
+// Holds at most capacity expressions, evicting the least recently used.
+// Recency is kept in a list, most recent first, and each entry holds its
+// position in it, so marking an entry as used and evicting are both O(1).
+// Safe to use from multiple threads. Hits only take a shared lock on the
+// entries, so concurrent readers don't block each other while looking up,
+// and then hold a separate lock for just the moment it takes to move the
+// entry to the front of the list.
+class ExpressionCache {
+    using Recency = std::list<const std::string*>; // Keys in entries.
+    struct Entry {
+        std::shared_ptr<const CompiledExpression> expression;
+        Recency::iterator position; // Guarded by recency_mutex.
+    };
+
+    const size_t capacity;
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::mutex recency_mutex; // Taken after mutex.
+    Recency recency;
+    std::atomic<uint64_t> hits{}, misses{};
+
+    // Called with mutex held.
+    void mark_used(Entry& entry) {
+        std::lock_guard lock{recency_mutex};
+        recency.splice(recency.begin(), recency, entry.position);
+    }
+public:
+    explicit ExpressionCache(size_t capacity) : capacity{capacity} {
+        if(capacity == 0) {
+            throw std::invalid_argument("Capacity must be at least 1");
+        }
+        entries.reserve(capacity);
+    }
+
+    // Throws if the text isn't a valid expression, in which case nothing is cached.
+    std::shared_ptr<const CompiledExpression> get(const std::string& text) {
+        {
+            std::shared_lock lock{mutex};
+            auto it = entries.find(text);
+            if(it != entries.end()) {
+                mark_used(it->second);
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second.expression;
+            }
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+        // Parse without holding the lock so other lookups aren't blocked.
+        auto expression = std::make_shared<const CompiledExpression>(text);
+
+        std::unique_lock lock{mutex};
+        auto it = entries.find(text);
+        if(it != entries.end()) { // Another thread got there first.
+            mark_used(it->second);
+            return it->second.expression;
+        }
+        std::lock_guard recency_lock{recency_mutex};
+        if(entries.size() >= capacity) {
+            entries.erase(entries.find(*recency.back()));
+            recency.pop_back();
+        }
+        it = entries.emplace(text, Entry{std::move(expression), {}}).first;
+        recency.push_front(&it->first);
+        it->second.position = recency.begin();
+        return it->second.expression;
+    }
+
+    size_t size() const {
+        std::shared_lock lock{mutex};
+        return entries.size();
+    }
+    uint64_t get_hits() const {
+        return hits.load(std::memory_order_relaxed);
+    }
+    uint64_t get_misses() const {
+        return misses.load(std::memory_order_relaxed);
+    }
+    double get_hit_rate() const {
+        uint64_t hits = get_hits(), lookups = hits + get_misses();
+        return lookups ? static_cast<double>(hits) / lookups : 0.0;
+    }
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <tuple>
+#include <vector>
+#include "Expression.h"
+
+// Counts the distinct nodes of an expression. Shared subtrees count once.
+inline size_t count_nodes(const Element& element, std::set<const Element*>& visited) {
+    if(!visited.insert(&element).second) {
+        return 0;
+    }
+    size_t count{1};
+    if(auto operation = dynamic_cast<const Operation*>(&element)) {
+        count += count_nodes(operation->get_lhs(), visited);
+        count += count_nodes(operation->get_rhs(), visited);
+    }
+    return count;
+}
+inline size_t count_nodes(const Element& element) {
+    std::set<const Element*> visited;
+    return count_nodes(element, visited);
+}
+
+// Rewrites a parsed expression into a cheaper one that evaluates to the same
+// result. Run it once between parse() and eval() for formulas that are
+// evaluated repeatedly.
+// - Constant subtrees are folded, e.g. (13-4) becomes 9.
+// - Identities are simplified, e.g. x+0 and x-0 become x, and x-x becomes 0.
+// - Identical subtrees are shared (hash-consing), e.g. both (x-y) in
+//   (x-y)+(x-y) become the same node.
+// The input expression isn't modified. Element::eval() still walks a shared
+// node once per parent, so sharing only saves memory; evaluate the result
+// with a MemoisedExpression to evaluate each shared node once.
+class ExpressionOptimizer {
+    using OperationKey = std::tuple<BinaryOperation::Type, const Element*, const Element*>;
+
+    std::map<int, std::shared_ptr<Element>> integers;
+    std::map<char, std::shared_ptr<Element>> variables;
+    std::map<OperationKey, std::shared_ptr<Element>> operations;
+    size_t nodes_before{}, nodes_after{};
+
+    std::shared_ptr<Element> make_integer(int value) {
+        auto& node = integers[value];
+        if(!node) {
+            node = std::make_shared<Integer>(value);
+        }
+        return node;
+    }
+    std::shared_ptr<Element> make_variable(char name) {
+        auto& node = variables[name];
+        if(!node) {
+            node = std::make_shared<Variable>(name);
+        }
+        return node;
+    }
+    std::shared_ptr<Element> make_operation(BinaryOperation::Type type,
+                                            const std::shared_ptr<Element>& lhs,
+                                            const std::shared_ptr<Element>& rhs) {
+        auto left = std::dynamic_pointer_cast<Integer>(lhs);
+        auto right = std::dynamic_pointer_cast<Integer>(rhs);
+        if(left && right) {
+            int value = type == BinaryOperation::addition
+                    ? left->get_value() + right->get_value()
+                    : left->get_value() - right->get_value();
+            return make_integer(value);
+        }
+        if(right && right->get_value() == 0) {
+            return lhs;
+        }
+        if(left && left->get_value() == 0 && type == BinaryOperation::addition) {
+            return rhs;
+        }
+        // Children are already shared, so identical subtrees are the same node.
+        if(lhs == rhs && type == BinaryOperation::subtraction) {
+            return make_integer(0);
+        }
+        auto& node = operations[OperationKey{type, lhs.get(), rhs.get()}];
+        if(!node) {
+            auto operation = std::make_shared<BinaryOperation>();
+            operation->type = type;
+            operation->lhs = lhs;
+            operation->rhs = rhs;
+            node = operation;
+        }
+        return node;
+    }
+    // Builds every node afresh, so the result never shares nodes with the input.
+    std::shared_ptr<Element> rewrite(const Element& element) {
+        if(auto integer = dynamic_cast<const Integer*>(&element)) {
+            return make_integer(integer->get_value());
+        }
+        if(auto variable = dynamic_cast<const Variable*>(&element)) {
+            return make_variable(variable->get_name());
+        }
+        auto& operation = dynamic_cast<const Operation&>(element);
+        return make_operation(operation.type,
+                              rewrite(operation.get_lhs()),
+                              rewrite(operation.get_rhs()));
+    }
+public:
+    // The result is independent of the input, which can be e.g. the root of a
+    // CompiledExpression.
+    std::shared_ptr<Element> optimize(const Element& expression) {
+        integers.clear();
+        variables.clear();
+        operations.clear();
+        auto result = rewrite(expression);
+        nodes_before = count_nodes(expression);
+        nodes_after = count_nodes(*result);
+        return result;
+    }
+    std::shared_ptr<Element> optimize(const std::shared_ptr<Element>& expression) {
+        return optimize(*expression);
+    }
+
+    // Node counts of the expression given to, and returned by, the last optimize().
+    size_t get_nodes_before() const {
+        return nodes_before;
+    }
+    size_t get_nodes_after() const {
+        return nodes_after;
+    }
+};
+
+// Evaluates an expression so that each distinct node is evaluated once per
+// call, however many parents share it. The nodes are put in an order where
+// children come before their parents, and eval() works through it storing
+// each node's value by its position, so a shared node's value is computed
+// once and then looked up.
+class MemoisedExpression {
+    std::shared_ptr<Element> root; // Keeps the nodes alive.
+    std::vector<Step> steps;
+public:
+    explicit MemoisedExpression(std::shared_ptr<Element> expression)
+        : root{std::move(expression)}, steps{flatten(*root)} {}
+
+    // Number of nodes evaluated per call.
+    size_t size() const {
+        return steps.size();
+    }
+
+    int eval(const Variables& variables = {}) const {
+        // Reused between calls to save allocating, eval() never nests.
+        thread_local std::vector<int> values;
+        values.resize(steps.size());
+        for(size_t i{}; i < steps.size(); ++i) {
+            const Step& step = steps[i];
+            switch(step.kind) {
+                case Step::integer: {
+                    values[i] = step.value;
+                    break;
+                }
+                case Step::variable: {
+                    values[i] = variables.at(step.name);
+                    break;
+                }
+                case Step::operation: {
+                    values[i] = step.type == BinaryOperation::addition
+                            ? values[step.lhs] + values[step.rhs]
+                            : values[step.lhs] - values[step.rhs];
+                    break;
+                }
+            }
+        }
+        return values[steps.size() - 1];
+    }
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include "Expression.h"
+
+// Expression templates for formulas that are known at compile time. Each
+// element is a type and eval() is a static function, so there are no virtual
+// calls and the compiler can reduce a formula to straight-line code. Formulas
+// without variables can also be evaluated in constant expressions.
+template <int Value>
+class StaticInteger {
+public:
+    static constexpr int eval() {
+        return Value;
+    }
+    template <typename Vars>
+    static int eval(const Vars&) {
+        return Value;
+    }
+};
+template <char Name>
+class StaticVariable {
+public:
+    template <typename Vars>
+    static int eval(const Vars& variables) {
+        return variables.at(Name);
+    }
+};
+template <typename Lhs, typename Rhs>
+class StaticAddition {
+public:
+    static constexpr int eval() {
+        return Lhs::eval() + Rhs::eval();
+    }
+    template <typename Vars>
+    static int eval(const Vars& variables) {
+        return Lhs::eval(variables) + Rhs::eval(variables);
+    }
+};
+template <typename Lhs, typename Rhs>
+class StaticSubtraction {
+public:
+    static constexpr int eval() {
+        return Lhs::eval() - Rhs::eval();
+    }
+    template <typename Vars>
+    static int eval(const Vars& variables) {
+        return Lhs::eval(variables) - Rhs::eval(variables);
+    }
+};
+
+// Compile time counterpart of lex() and parse(), accepting the same grammar:
+// integers, single letter variables, + and -, parentheses and whitespace,
+// with operations being left associative. Any other character is an error in
+// both. Ranges of the text are [begin, end).
+class StaticGrammar {
+public:
+    enum Operand {invalid, integer, variable, parenthesised};
+
+    static constexpr size_t length(const char* text) {
+        size_t i{};
+        while(text[i] != '\0') {
+            ++i;
+        }
+        return i;
+    }
+    static constexpr bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+    static constexpr bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+    static constexpr bool is_alpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+    static constexpr size_t trim_begin(const char* text, size_t begin, size_t end) {
+        while(begin < end && is_space(text[begin])) {
+            ++begin;
+        }
+        return begin;
+    }
+    static constexpr size_t trim_end(const char* text, size_t begin, size_t end) {
+        while(end > begin && is_space(text[end-1])) {
+            --end;
+        }
+        return end;
+    }
+    // The operation evaluated last is the rightmost one outside parentheses.
+    // Returns end if there isn't one.
+    static constexpr size_t find_operator(const char* text, size_t begin, size_t end) {
+        size_t result{end};
+        int depth{};
+        for(size_t i{begin}; i < end; ++i) {
+            if(text[i] == '(') {
+                ++depth;
+            } else if(text[i] == ')') {
+                --depth;
+            } else if(depth == 0 && (text[i] == '+' || text[i] == '-')) {
+                result = i;
+            }
+        }
+        return result;
+    }
+    // Expects a trimmed range.
+    static constexpr Operand find_operand(const char* text, size_t begin, size_t end) {
+        if(begin == end) {
+            return invalid;
+        }
+        if(text[begin] == '(') {
+            int depth{};
+            for(size_t i{begin}; i < end; ++i) {
+                depth += text[i] == '(' ? 1 : text[i] == ')' ? -1 : 0;
+                if(depth == 0 && i + 1 != end) {
+                    return invalid; // e.g. "(1)(2)".
+                }
+            }
+            return depth == 0 ? parenthesised : invalid;
+        }
+        if(end - begin == 1 && is_alpha(text[begin])) {
+            return variable;
+        }
+        for(size_t i{begin}; i < end; ++i) {
+            if(!is_digit(text[i])) {
+                return invalid;
+            }
+        }
+        return integer;
+    }
+    static constexpr int to_int(const char* text, size_t begin, size_t end) {
+        int result{};
+        for(size_t i{begin}; i < end; ++i) {
+            result = result * 10 + (text[i] - '0');
+        }
+        return result;
+    }
+
+    // Whether StaticExpression compiles for the text, following the same
+    // steps as StaticParser, so it can be checked without failing the build.
+    static constexpr bool accepts(const char* text, size_t begin, size_t end) {
+        size_t op = find_operator(text, begin, end);
+        if(op != end) {
+            return accepts(text, begin, op) && accepts(text, op + 1, end);
+        }
+        begin = trim_begin(text, begin, end);
+        end = trim_end(text, begin, end);
+        switch(find_operand(text, begin, end)) {
+            case invalid: {
+                return false;
+            }
+            case parenthesised: {
+                return accepts(text, begin + 1, end - 1);
+            }
+            default: {
+                return true;
+            }
+        }
+    }
+    static constexpr bool accepts(const char* text) {
+        return accepts(text, 0, length(text));
+    }
+};
+
+template <const char* Text, size_t Begin, size_t End,
+          size_t Operator = StaticGrammar::find_operator(Text, Begin, End)>
+class StaticParser { // Operation.
+    using Lhs = typename StaticParser<Text, Begin, Operator>::type;
+    using Rhs = typename StaticParser<Text, Operator+1, End>::type;
+public:
+    using type = std::conditional_t<Text[Operator] == '+',
+                                    StaticAddition<Lhs, Rhs>,
+                                    StaticSubtraction<Lhs, Rhs>>;
+};
+
+template <const char* Text, size_t Begin, size_t End,
+          StaticGrammar::Operand Kind = StaticGrammar::find_operand(Text, Begin, End)>
+class StaticOperandParser {
+    static_assert(Kind != StaticGrammar::invalid, "Invalid expression: missing or malformed operand");
+};
+template <const char* Text, size_t Begin, size_t End>
+class StaticOperandParser<Text, Begin, End, StaticGrammar::integer> {
+public:
+    using type = StaticInteger<StaticGrammar::to_int(Text, Begin, End)>;
+};
+template <const char* Text, size_t Begin, size_t End>
+class StaticOperandParser<Text, Begin, End, StaticGrammar::variable> {
+public:
+    using type = StaticVariable<Text[Begin]>;
+};
+template <const char* Text, size_t Begin, size_t End>
+class StaticOperandParser<Text, Begin, End, StaticGrammar::parenthesised> {
+public:
+    using type = typename StaticParser<Text, Begin+1, End-1>::type;
+};
+
+template <const char* Text, size_t Begin, size_t End>
+class StaticParser<Text, Begin, End, End> { // Operand.
+public:
+    using type = typename StaticOperandParser<Text,
+            StaticGrammar::trim_begin(Text, Begin, End),
+            StaticGrammar::trim_end(Text, Begin, End)>::type;
+};
+
+// The text must have static storage duration, e.g.
+//     static constexpr char formula[] = "(13-4)-(12+1)";
+//     static_assert(StaticExpression<formula>::eval() == -4);
+template <const char* Text>
+using StaticExpression = typename StaticParser<Text, 0, StaticGrammar::length(Text)>::type;
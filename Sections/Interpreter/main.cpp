@@ -1,150 +1,243 @@
 #include <iostream>
-#include <vector>
-#include <sstream>
-#include <memory>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "Expression.h"
+#include "Optimizer.h"
+#include "CompiledExpression.h"
+#include "ExpressionCache.h"
+#include "StaticExpression.h"
 
-class Token {
-public:
-    friend std::ostream& operator<<(std::ostream& os, const Token& token) {
-        os << '\'' << token.text << '\'';
-        return os;
+void use_interpreter() {
+    std::string expression = "(13-4)-(12+1)";
+    auto tokens = lex(expression);
+    for(const auto& token : tokens) {
+        std::cout << token << ' ';
     }
+    std::cout << std::endl;
 
-    enum Type {integer, plus, minus, lparen, rparen} type;
-    std::string text;
+    try {
+        auto parsed = parse(tokens);
+        std::cout << expression << " = " << parsed->eval() << std::endl;
 
-    Token(Type type, const std::string& text)
-            : type{type}, text{text} {}
-};
+        std::string formula = "x-(y+3)";
+        Variables variables {{'x', 10}, {'y', 2}};
+        std::cout << formula << " = " << parse(lex(formula))->eval(variables)
+                  << " where x = 10, y = 2" << std::endl;
+    } catch(const std::exception& e) {
+        std::cout << "Failed: " << e.what() << std::endl;
+    }
+}
 
-class Element {
-public:
-    virtual int eval() const = 0;
-};
-class Integer : public Element {
-    int value;
-public:
-    Integer(int value) : value(value) {}
+void use_batch_evaluation() {
+    using namespace std::chrono;
+    const size_t rows{1'000'000};
+    std::vector<int> x(rows), y(rows), batch(rows), single(rows);
+    std::mt19937 random;
+    std::uniform_int_distribution<int> values{-1000, 1000};
+    for(size_t i{}; i < rows; ++i) {
+        x[i] = values(random);
+        y[i] = values(random);
+    }
 
-    int eval() const override {
-        return value;
+    std::string formula = "(x-4)-(y+1)+(x-y)";
+    auto parsed = parse(lex(formula));
+
+    // One call to eval() per row.
+    auto start = steady_clock::now();
+    for(size_t i{}; i < rows; ++i) {
+        single[i] = parsed->eval({{'x', x[i]}, {'y', y[i]}});
     }
-};
-class BinaryOperation : public Element {
-public:
-    std::shared_ptr<Element> lhs, rhs;
-    enum Type {addition, subtraction} type;
+    auto single_time = duration_cast<milliseconds>(steady_clock::now() - start);
 
-    int eval() const override {
-        auto left = lhs->eval();
-        auto right = rhs->eval();
-        if(type == addition) {
-            return left + right;
-        } else {
-            return left - right;
-        }
+    // One pass over the flattened expression per block of rows.
+    start = steady_clock::now();
+    eval_batch(*parsed, {{'x', x.data()}, {'y', y.data()}}, rows, batch.data());
+    auto batch_time = duration_cast<milliseconds>(steady_clock::now() - start);
+
+    std::cout << formula << " over " << rows << " rows:" << std::endl
+              << "  Per row: " << single_time.count() << "ms" << std::endl
+              << "  Batched: " << batch_time.count() << "ms" << std::endl
+              << "  Results match: " << std::boolalpha << (single == batch) << std::endl;
+
+    // A long formula nests deeply, which batch evaluation handles as well as eval().
+    std::string deep_formula = "x";
+    for(int i{}; i < 20'000; ++i) {
+        deep_formula += "+1";
     }
-};
+    auto deep = parse(lex(deep_formula));
+    const size_t deep_rows{1000};
+    eval_batch(*deep, {{'x', x.data()}}, deep_rows, batch.data());
+    bool deep_match{true};
+    for(size_t i{}; i < deep_rows; ++i) {
+        deep_match = deep_match && batch[i] == deep->eval({{'x', x[i]}});
+    }
+    std::cout << "  20000 term formula, results match: " << deep_match << std::endl;
+}
 
-std::vector<Token> lex(std::string exp) { // Lexing/tokenisation converts a string into a token.
-    std::vector<Token> result;
-    for(size_t i{}; i < exp.size(); ++i) {
-        switch(exp[i]) {
-            case '+': {
-                result.emplace_back(Token::plus, "+");
-                break;
-            }
-            case '-': {
-                result.emplace_back(Token::minus, "-");
-                break;
-            }
-            case '(': {
-                result.emplace_back(Token::lparen, "(");
-                break;
-            }
-            case ')': {
-                result.emplace_back(Token::rparen, ")");
-                break;
-            }
-            default: {
-                std::ostringstream buffer;
-                buffer << exp[i];
-                for(i += 1; i < exp.size(); ++i) {
-                    if(std::isdigit(exp[i])) {
-                        buffer << exp[i];
-                    } else {
-                        result.emplace_back(Token::integer, buffer.str());
-                        i -= 1;
-                        break;
-                    }
-                }
-            }
+void use_optimizer() {
+    using namespace std::chrono;
+    std::string formula = "((13-4)-(12+1))+(x-y)+((x-y)+0)-(y-y)";
+    auto parsed = parse(lex(formula));
+    ExpressionOptimizer optimizer;
+    auto optimized = optimizer.optimize(parsed);
+    std::cout << formula << std::endl
+              << "  Nodes: " << optimizer.get_nodes_before()
+              << " -> " << optimizer.get_nodes_after() << std::endl;
+
+    const int repeats{1'000'000};
+    auto time_evals = [&](const Element& expression) {
+        long long total{};
+        auto start = steady_clock::now();
+        for(int i{}; i < repeats; ++i) {
+            total += expression.eval({{'x', i}, {'y', 7}});
         }
+        auto time = duration_cast<milliseconds>(steady_clock::now() - start);
+        return std::make_pair(total, time.count());
+    };
+    auto original = time_evals(*parsed);
+    auto folded = time_evals(*optimized);
+    // Shared subtrees are only evaluated once.
+    MemoisedExpression memoised{optimized};
+    long long memoised_total{};
+    auto start = steady_clock::now();
+    for(int i{}; i < repeats; ++i) {
+        memoised_total += memoised.eval({{'x', i}, {'y', 7}});
     }
-    return result;
+    auto memoised_time = duration_cast<milliseconds>(steady_clock::now() - start);
+    std::cout << "  Original:  " << original.second << "ms" << std::endl
+              << "  Optimized: " << folded.second << "ms" << std::endl
+              << "  Optimized, shared nodes evaluated once: " << memoised_time.count() << "ms" << std::endl
+              << "  Results match: " << std::boolalpha
+              << (original.first == folded.first && original.first == memoised_total) << std::endl;
 }
-std::unique_ptr<BinaryOperation> parse(std::vector<Token> tokens) {
-    auto result = std::make_unique<BinaryOperation>();
-    bool have_lhs{false};
-    for(size_t i{}; i < tokens.size(); ++i) {
-        auto& token {tokens[i]};
-        switch(token.type) {
-            case Token::integer: {
-                int to_int = std::stoi(token.text);
-                auto to_integer = std::make_unique<Integer>(to_int);
-                if(!have_lhs) {
-                    result->lhs = std::move(to_integer);
-                    have_lhs = true;
-                } else {
-                    result->rhs = std::move(to_integer);
-                }
-                break;
-            }
-            case Token::plus: {
-                result->type = BinaryOperation::addition;
-                break;
-            }
-            case Token::minus: {
-                result->type = BinaryOperation::subtraction;
-                break;
-            }
-            case Token::lparen: {
-                size_t j = i;
-                for(; j < tokens.size(); ++j) {
-                    if(tokens[j].type == Token::rparen) {
-                        break;
-                    }
-                }
-                std::vector<Token> subexpression(&tokens[i+1], &tokens[j]);
-                auto element = parse(subexpression);
-                if(!have_lhs) {
-                    result->lhs = std::move(element);
-                    have_lhs = true;
-                } else {
-                    result->rhs = std::move(element);
-                }
-                i = j;
-                break;
+
+void use_compiled_expression() {
+    using namespace std::chrono;
+    std::ostringstream buffer;
+    buffer << 'x';
+    for(int i{}; i < 5'000; ++i) {
+        buffer << (i % 2 ? '+' : '-') << "(y-" << i << ')';
+    }
+    std::string formula = buffer.str();
+    auto tokens = lex(formula);
+    const int repeats{100};
+
+    long long heap_total{};
+    auto start = steady_clock::now();
+    for(int i{}; i < repeats; ++i) {
+        auto parsed = parse(lex(formula));
+        heap_total += parsed->eval({{'x', i}, {'y', 3}});
+    }
+    auto heap_time = duration_cast<milliseconds>(steady_clock::now() - start);
+
+    long long arena_total{};
+    start = steady_clock::now();
+    for(int i{}; i < repeats; ++i) {
+        CompiledExpression compiled{formula};
+        arena_total += compiled.eval({{'x', i}, {'y', 3}});
+    }
+    auto arena_time = duration_cast<milliseconds>(steady_clock::now() - start);
+
+    std::cout << "Parse, eval and destroy a " << tokens.size() << " token expression "
+              << repeats << " times:" << std::endl
+              << "  Heap:  " << heap_time.count() << "ms" << std::endl
+              << "  Arena: " << arena_time.count() << "ms" << std::endl
+              << "  Results match: " << std::boolalpha << (heap_total == arena_total) << std::endl;
+}
+
+void use_expression_cache() {
+    // A few formulas are used far more often than the rest.
+    std::vector<std::string> formulas;
+    for(int i{}; i < 200; ++i) {
+        formulas.push_back("(x+" + std::to_string(i) + ")-(y-" + std::to_string(i % 7) + ")");
+    }
+    ExpressionCache cache{64};
+    std::vector<std::thread> threads;
+    std::vector<long long> totals(4);
+    for(size_t t{}; t < totals.size(); ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 random(t);
+            std::geometric_distribution<size_t> pick{0.05};
+            for(int i{}; i < 100'000; ++i) {
+                auto& formula = formulas[pick(random) % formulas.size()];
+                totals[t] += cache.get(formula)->eval({{'x', i}, {'y', 1}});
             }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    // The same lookups again, parsing each formula once and without the cache.
+    std::vector<std::shared_ptr<Element>> parsed;
+    for(auto& formula : formulas) {
+        parsed.push_back(parse(lex(formula)));
+    }
+    bool match{true};
+    for(size_t t{}; t < totals.size(); ++t) {
+        std::mt19937 random(t);
+        std::geometric_distribution<size_t> pick{0.05};
+        long long total{};
+        for(int i{}; i < 100'000; ++i) {
+            total += parsed[pick(random) % formulas.size()]->eval({{'x', i}, {'y', 1}});
         }
+        match = match && total == totals[t];
     }
-    return result;
+    std::cout << "Expression cache with capacity 64, " << formulas.size() << " formulas:" << std::endl
+              << "  Hits: " << cache.get_hits() << ", misses: " << cache.get_misses()
+              << ", hit rate: " << cache.get_hit_rate() << std::endl
+              << "  Results match uncached evaluation: " << std::boolalpha << match << std::endl;
 }
 
-int main() {
-    std::string expression = "(13-4)-(12+1)";
-    auto tokens = lex(expression);
-    for(const auto& token : tokens) {
-        std::cout << '\'' << token.text << '\'' << ' ';
-    }
-    std::cout << std::endl;
+static constexpr char constant_formula[] = "(13-4)-(12+1)";
+static constexpr char variable_formula[] = "x - ((y+3) - (x-10)) + 7";
 
-    try {
-        auto parsed = parse(tokens);
-        std::cout << expression << " = " << parsed->eval() << std::endl;
-    } catch(const std::exception& e) {
+void use_static_expression() {
+    // Evaluated by the compiler, no parsing at run time.
+    using Constant = StaticExpression<constant_formula>;
+    static_assert(Constant::eval() == -4, "Unexpected result");
+    std::cout << constant_formula << " = " << Constant::eval() << std::endl;
 
+    // Both paths accept the same grammar and must give the same results.
+    using Formula = StaticExpression<variable_formula>;
+    auto parsed = parse(lex(variable_formula));
+    bool match = parse(lex(constant_formula))->eval() == Constant::eval();
+    for(int x{-50}; x <= 50; ++x) {
+        for(int y{-50}; y <= 50; ++y) {
+            Variables variables {{'x', x}, {'y', y}};
+            match = match && parsed->eval(variables) == Formula::eval(variables);
+        }
     }
+    // Malformed input must be rejected by both, the static path at compile time.
+    static_assert(!StaticGrammar::accepts("x $+ 1"), "Unexpected character accepted");
+    for(auto text : {"x $+ 1", "x + 1", "(1)(2)", "1 2", "-x", "x+", "((x)-(y))"}) {
+        bool accepted{true};
+        try {
+            parse(lex(text));
+        } catch(const std::runtime_error&) {
+            accepted = false;
+        }
+        match = match && accepted == StaticGrammar::accepts(text);
+    }
+    std::cout << variable_formula << " = " << Formula::eval(Variables{{'x', 10}, {'y', 2}})
+              << " where x = 10, y = 2" << std::endl
+              << "  Compile time and run time results match: " << std::boolalpha
+              << match << std::endl;
+}
+
+int main() {
+    use_interpreter();
+    std::cout << std::endl;
+    use_batch_evaluation();
+    std::cout << std::endl;
+    use_optimizer();
+    std::cout << std::endl;
+    use_compiled_expression();
+    std::cout << std::endl;
+    use_expression_cache();
+    std::cout << std::endl;
+    use_static_expression();
 
     return 0;
 }
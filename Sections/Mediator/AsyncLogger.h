@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes lines to a stream on its own thread, so whoever logs them doesn't
+// wait for the I/O. Lines are written in the order they were logged.
+class AsyncLogger {
+    std::ostream& os;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::vector<std::string> lines;
+    bool writing{false};
+    bool stopping{false};
+    std::thread writer;
+
+    void run() {
+        std::vector<std::string> batch;
+        std::unique_lock lock{mutex};
+        while(true) {
+            wake.wait(lock, [this]() { return stopping || !lines.empty(); });
+            if(lines.empty()) { // Stopping, and everything's been written.
+                return;
+            }
+            batch.swap(lines);
+            writing = true;
+            lock.unlock();
+            for(const auto& line : batch) {
+                os << line << '\n';
+            }
+            os.flush();
+            batch.clear();
+            lock.lock();
+            writing = false;
+            if(lines.empty()) {
+                idle.notify_all();
+            }
+        }
+    }
+public:
+    explicit AsyncLogger(std::ostream& os) : os(os), writer(&AsyncLogger::run, this) {}
+    // Writes anything still logged before returning.
+    ~AsyncLogger() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        writer.join();
+    }
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    void log(std::string line) {
+        {
+            std::lock_guard lock{mutex};
+            lines.push_back(std::move(line));
+        }
+        wake.notify_one();
+    }
+    // Waits until everything logged so far has been written.
+    void flush() {
+        std::unique_lock lock{mutex};
+        idle.wait(lock, [this]() { return !writing && lines.empty(); });
+    }
+};
+
+// Logger for std::cout. Anything else writing to std::cout should flush it
+// first to keep the output in order.
+inline AsyncLogger& console_logger() {
+    static AsyncLogger logger{std::cout};
+    return logger;
+}
@@ -1,34 +1,261 @@
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
 #include "Chatroom.h"
 
-void Chatroom::broadcast(const std::string &origin, const std::string &message) {
-    for(auto it = people.begin(); it != people.end(); ++it) {
-        std::weak_ptr<Person> w_ptr = *it;
-        if(w_ptr.expired()) {
-            it = people.erase(it);
+Chatroom::Chatroom(size_t shard_capacity) : shard_capacity(std::max<size_t>(shard_capacity, 1)) {
+
+}
+
+void Chatroom::set_dispatcher(WorkerPool* dispatcher, size_t mailbox_capacity, Overflow overflow) {
+    flush();
+    this->dispatcher = dispatcher;
+    this->mailbox_capacity = mailbox_capacity;
+    this->overflow = overflow;
+    if(dispatcher) {
+        for(const auto& shard : shards) {
+            for(const auto& member : shard.members) {
+                if(std::shared_ptr<Person> person = member.lock(); person && !person->mailbox) {
+                    person->mailbox = std::make_unique<Mailbox<MessagePtr>>(mailbox_capacity);
+                }
+            }
+        }
+    }
+}
+
+void Chatroom::flush() {
+    while(undelivered.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+size_t Chatroom::get_dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void Chatroom::deliver(const std::shared_ptr<Person>& person, const MessagePtr& message) {
+    if(!dispatcher) {
+        person->receive(message);
+        return;
+    }
+    undelivered.fetch_add(1, std::memory_order_relaxed);
+    while(!person->mailbox->try_push(message)) {
+        if(overflow == Overflow::drop) {
+            undelivered.fetch_sub(1, std::memory_order_release);
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+    // Pushed first, so a drain that's finishing either sees the message or
+    // has already released the mailbox for this sender to schedule.
+    if(!person->scheduled.exchange(true, std::memory_order_acq_rel)) {
+        dispatcher->post([room = shared_from_this(), person]() {
+            room->drain(person);
+        });
+    }
+}
+
+void Chatroom::drain(std::shared_ptr<Person> person) {
+    // Only the holder of person->scheduled drains, so there's one at a time.
+    size_t count = person->mailbox->consume([&person](const MessagePtr& message) {
+        person->receive(message);
+    }, drain_batch);
+    undelivered.fetch_sub(count, std::memory_order_release);
+    if(count < drain_batch) {
+        person->scheduled.exchange(false, std::memory_order_acq_rel);
+        // A sender that pushed before the release saw it still scheduled, so
+        // its message is picked up here, unless a new drain already has it.
+        if(person->mailbox->empty() || person->scheduled.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+    dispatcher->post([room = shared_from_this(), person = std::move(person)]() {
+        room->drain(person);
+    });
+}
+
+void Chatroom::swap_and_pop(std::vector<Member>& members, size_t slot) {
+    if(slot + 1 != members.size()) {
+        members[slot] = std::move(members.back());
+        if(std::shared_ptr<Person> moved = members[slot].lock()) {
+            moved->slot = slot;
+        }
+    }
+    members.pop_back();
+}
+
+void Chatroom::open(size_t shard) {
+    if(!shards[shard].listed) {
+        shards[shard].listed = true;
+        open_shards.push_back(shard);
+    }
+}
+
+void Chatroom::remove(size_t shard, size_t slot) {
+    swap_and_pop(shards[shard].members, slot);
+    open(shard);
+}
+
+void Chatroom::compact_step() {
+    for(size_t step{}; step < compaction_steps && !shards.empty(); ++step) {
+        if(cursor_shard >= shards.size()) {
+            cursor_shard = 0;
+            cursor_slot = 0;
+        }
+        auto& members = shards[cursor_shard].members;
+        if(cursor_slot >= members.size()) {
+            ++cursor_shard;
+            cursor_slot = 0;
+        } else if(members[cursor_slot].expired()) {
+            ++stale_entries;
+            remove(cursor_shard, cursor_slot); // Another member moves into the slot.
+        } else {
+            ++cursor_slot;
+        }
+    }
+    if(stale_entries > index.size() / 2) {
+        sweep_index();
+    }
+}
+
+void Chatroom::sweep_index() {
+    for(auto it = index.begin(); it != index.end();) {
+        if(it->second.expired()) {
+            it = index.erase(it);
         } else {
-            std::shared_ptr<Person> person = w_ptr.lock();
-            if(person->get_name() != origin) {
-                person->receive(origin, message);
+            ++it;
+        }
+    }
+    stale_entries = 0;
+}
+
+void Chatroom::deliver_shard(Shard& shard, const MessagePtr& message) {
+    auto& members = shard.members;
+    for(size_t i{}; i < members.size();) {
+        std::shared_ptr<Person> person = members[i].lock();
+        if(!person) {
+            // The last member moves into the slot, and is delivered to next.
+            ++shard.stale_entries;
+            swap_and_pop(members, i);
+            continue;
+        }
+        if(person->get_name() != message->get_origin()) {
+            deliver(person, message);
+        }
+        ++i;
+    }
+}
+
+void Chatroom::broadcast(const MessagePtr& message) {
+    // Posting to mailboxes is cheap, and a sender blocked on a full one
+    // mustn't hold up a pool thread, so asynchronous rooms fan out on the
+    // calling thread.
+    bool sharded = shards.size() > 1 && !dispatcher;
+    if(sharded) {
+        if(!pool) {
+            pool = std::make_unique<WorkerPool>();
+        }
+        for(size_t i{1}; i < shards.size(); ++i) {
+            if(!shards[i].members.empty()) {
+                pool->post([this, i, &message]() {
+                    deliver_shard(shards[i], message);
+                });
             }
         }
     }
+    for(size_t i{}; i < (sharded ? 1 : shards.size()); ++i) {
+        deliver_shard(shards[i], message);
+    }
+    if(sharded) {
+        pool->wait_idle();
+    }
+    // Shards are compacted in parallel, so the room's bookkeeping is updated
+    // once they're done.
+    for(size_t i{}; i < shards.size(); ++i) {
+        stale_entries += shards[i].stale_entries;
+        shards[i].stale_entries = 0;
+        if(shards[i].members.size() < shard_capacity) {
+            open(i);
+        }
+    }
+    if(stale_entries > index.size() / 2) {
+        sweep_index();
+    }
 }
 
-void Chatroom::join(std::shared_ptr<Person> person) {
+void Chatroom::broadcast(const std::string &origin, const std::string &message) {
+    broadcast(std::make_shared<const Message>(origin, message));
+}
+
+void Chatroom::join(std::shared_ptr<Person> person, bool announce) {
+    // An expired member's name can be taken.
+    auto [it, inserted] = index.try_emplace(person->get_name(), person);
+    if(!inserted) {
+        if(!it->second.expired()) {
+            throw std::invalid_argument("Name " + person->get_name() + " is already taken");
+        }
+        it->second = person;
+    }
     person->set_room(shared_from_this());
-    people.push_back(person);
-    std::string join_msg = person->get_name() + " joined the chat.";
-    broadcast("Room", join_msg);
+    while(!open_shards.empty() && shards[open_shards.back()].members.size() >= shard_capacity) {
+        shards[open_shards.back()].listed = false;
+        open_shards.pop_back();
+    }
+    if(open_shards.empty()) {
+        shards.emplace_back();
+        open(shards.size() - 1);
+    }
+    person->shard = open_shards.back();
+    auto& members = shards[person->shard].members;
+    person->slot = members.size();
+    if(dispatcher && !person->mailbox) {
+        person->mailbox = std::make_unique<Mailbox<MessagePtr>>(mailbox_capacity);
+    }
+    members.push_back(person);
+    compact_step();
+    if(announce) {
+        std::string join_msg = person->get_name() + " joined the chat.";
+        broadcast("Room", join_msg);
+    }
+}
+
+void Chatroom::leave(const std::shared_ptr<Person>& person) {
+    if(person->shard >= shards.size()) {
+        return;
+    }
+    auto& members = shards[person->shard].members;
+    if(person->slot >= members.size() || members[person->slot].lock() != person) {
+        return; // Not a member.
+    }
+    index.erase(person->get_name());
+    remove(person->shard, person->slot);
+    person->set_room(nullptr);
+    compact_step();
+}
+
+void Chatroom::message(const std::string& who, const MessagePtr& message) {
+    auto it = index.find(who);
+    if(it == index.end()) {
+        return;
+    }
+    if(std::shared_ptr<Person> person = it->second.lock()) {
+        deliver(person, message);
+    }
 }
 
 void Chatroom::message(const std::string& origin, const std::string& who, const std::string& message) {
-    for(auto w_ptr : people) {
-        if(!w_ptr.expired()) {
-            std::shared_ptr<Person> person = w_ptr.lock();
-            if(person->get_name() == who) {
-                person->receive(origin, message);
-                break;
-            }
-        }
+    this->message(who, std::make_shared<const Message>(origin, message));
+}
+
+size_t Chatroom::get_shard_count() const {
+    return shards.size();
+}
+
+size_t Chatroom::get_member_count() const {
+    size_t count{};
+    for(const auto& shard : shards) {
+        count += shard.members.size();
     }
+    return count;
 }
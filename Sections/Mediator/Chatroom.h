@@ -1,14 +1,100 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "Person.h"
+#include "WorkerPool.h"
 
+// Members are indexed by name, so a private message goes straight to its
+// recipient rather than scanning the room. Names are unique among the members
+// present. They're also split into shards of
+// up to shard_capacity; a broadcast to a room with more than one shard
+// delivers each shard on a worker pool, with the calling thread taking the
+// first. Small rooms have one shard and are delivered on the calling thread.
+// Each message is one shared record, however many people receive it.
+// Given a dispatcher, messages are instead posted to each member's bounded
+// mailbox, actor style, and the dispatcher's threads drain the mailboxes, so
+// senders don't wait for recipients. When a mailbox is full the sender either
+// blocks until there's space or the message is dropped.
+// Members who leave, or expire without leaving, are removed by moving the
+// last member of their shard into their place, so removal is O(1) but the
+// order members are delivered to can change. Expired members are compacted
+// away as broadcasts come across them, and a few at a time on each join and
+// leave.
 class Chatroom : public std::enable_shared_from_this<Chatroom> {
-    std::vector<std::weak_ptr<Person>> people;
 public:
+    enum class Overflow {block, drop};
+private:
+    using Member = std::weak_ptr<Person>;
+    struct Shard {
+        std::vector<Member> members;
+        // Set by a broadcast's compaction, collected afterwards.
+        size_t stale_entries{};
+        bool listed{false}; // In open_shards.
+    };
+    // Messages a mailbox drain receives before requeueing itself, so busy
+    // members don't hold on to a thread.
+    static constexpr size_t drain_batch{64};
+    // Members checked for expiry on each join and leave. More than one, so
+    // compaction keeps up with a room that's only growing.
+    static constexpr size_t compaction_steps{2};
+
+    std::vector<Shard> shards;
+    // Each shard is listed at most once, and may have filled since.
+    std::vector<size_t> open_shards;
+    std::unordered_map<std::string, std::weak_ptr<Person>> index;
+    size_t stale_entries{}; // Roughly how many index entries have expired.
+    size_t cursor_shard{}, cursor_slot{}; // Next member compact_step() checks.
+    std::unique_ptr<WorkerPool> pool; // Created by the first sharded broadcast.
+    size_t shard_capacity;
+
+    WorkerPool* dispatcher{};
+    size_t mailbox_capacity{64};
+    Overflow overflow{Overflow::block};
+    std::atomic<size_t> undelivered{}; // Posted to mailboxes and not yet received.
+    std::atomic<size_t> dropped{};
+
+    static void swap_and_pop(std::vector<Member>& members, size_t slot);
+    void open(size_t shard);
+    void remove(size_t shard, size_t slot);
+    void compact_step();
+    void sweep_index();
+    void deliver_shard(Shard& shard, const MessagePtr& message);
+    void drain(std::shared_ptr<Person> person);
+public:
+    explicit Chatroom(size_t shard_capacity = 4096);
+
+    // Nullptr, the default, delivers messages synchronously. The dispatcher
+    // must outlive the room, and mustn't be the room's own sharding pool.
+    // mailbox_capacity must be a power of two.
+    void set_dispatcher(WorkerPool* dispatcher, size_t mailbox_capacity = 64,
+                        Overflow overflow = Overflow::block);
+    // Waits until every message posted to a mailbox so far has been received.
+    void flush();
+    // Messages dropped because a mailbox was full.
+    size_t get_dropped() const;
+
+    // Delivers to one member, regardless of name.
+    void deliver(const std::shared_ptr<Person>& person, const MessagePtr& message);
+    // Delivered to everyone but its origin.
+    void broadcast(const MessagePtr& message);
     void broadcast(const std::string& origin,
                    const std::string& message);
-    void join(std::shared_ptr<Person> person);
+    // Throws if a member present already has the person's name. Announcing
+    // every join to a room being filled is quadratic, so it's optional.
+    void join(std::shared_ptr<Person> person, bool announce = true);
+    // O(1). The person mustn't talk afterwards, until they join a room again.
+    void leave(const std::shared_ptr<Person>& person);
+    void message(const std::string& who,
+                 const MessagePtr& message);
     void message(const std::string& origin,
                  const std::string& who,
                  const std::string& message);
-};
\ No newline at end of file
+
+    size_t get_shard_count() const;
+    // Members held by the room, including expired ones not yet compacted.
+    size_t get_member_count() const;
+};
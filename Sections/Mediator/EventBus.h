@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include "Signal.h"
+
+// Position of E in Events, or sizeof...(Events) if it isn't one of them.
+template <typename E, typename...Events>
+constexpr size_t event_index() {
+    constexpr bool matches[] = {std::is_same_v<E, Events>..., false};
+    for(size_t i{}; i < sizeof...(Events); ++i) {
+        if(matches[i]) {
+            return i;
+        }
+    }
+    return sizeof...(Events);
+}
+
+// Publishes events of each of the types in Events to the handlers subscribed
+// to that type. The type's signal is found at compile time, so publishing
+// needs no RTTI or lookups, and handlers only see the events they asked for.
+// E.g. EventBus<PlayerScoredData, PlayerSentOffData>.
+template <typename...Events>
+class EventBus {
+    static_assert(sizeof...(Events) > 0, "An event bus needs event types");
+
+    std::tuple<Signal<void(const Events&)>...> signals;
+
+    template <typename E>
+    static constexpr size_t index() {
+        constexpr size_t position = event_index<E, Events...>();
+        static_assert(position < sizeof...(Events), "Not an event type of this bus");
+        return position;
+    }
+    template <typename E>
+    static void disconnect(EventBus& bus, size_t id) {
+        std::get<index<E>()>(bus.signals).disconnect(id);
+    }
+    // Indexed by event type, so a Connection can be disconnected without
+    // knowing its type at compile time.
+    static constexpr std::array<void(*)(EventBus&, size_t), sizeof...(Events)>
+            disconnectors{&disconnect<Events>...};
+public:
+    struct Connection {
+        size_t type;
+        size_t id;
+    };
+
+    template <typename E>
+    Connection subscribe(Delegate<void(const E&)> handler) {
+        return {index<E>(), std::get<index<E>()>(signals).connect(std::move(handler))};
+    }
+    void unsubscribe(Connection connection) {
+        disconnectors[connection.type](*this, connection.id);
+    }
+
+    template <typename E>
+    void publish(const E& event) const {
+        std::get<index<E>()>(signals)(event);
+    }
+
+    template <typename E>
+    size_t handler_count() const {
+        return std::get<index<E>()>(signals).size();
+    }
+};
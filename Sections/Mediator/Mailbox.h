@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+// Bounded lock-free queue of messages for one recipient. Any number of
+// threads can send to it, and one at a time receives from it. Each cell
+// carries a sequence number that tells senders when it's free to write and
+// the receiver when it's ready to read, so neither side locks.
+template <typename T>
+class Mailbox {
+    struct Cell {
+        std::atomic<size_t> sequence;
+        std::optional<T> value;
+    };
+
+    std::vector<Cell> cells;
+    const size_t mask;
+    // Kept on separate cache lines so senders and the receiver don't contend.
+    alignas(64) std::atomic<size_t> tail{}; // Next position to push to.
+    // Next position to pop from. Only the receiver writes it, but empty() can
+    // be called from any thread.
+    alignas(64) std::atomic<size_t> head{};
+public:
+    // Capacity must be a power of two.
+    explicit Mailbox(size_t capacity) : cells(capacity), mask{capacity - 1} {
+        if(capacity == 0 || (capacity & mask) != 0) {
+            throw std::invalid_argument("Capacity must be a power of two");
+        }
+        for(size_t i{}; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const {
+        return cells.size();
+    }
+
+    // Returns false if the mailbox is full. Safe to call from any thread.
+    bool try_push(const T& value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true) {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+            if(difference == 0) {
+                if(tail.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(difference < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value.emplace(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Safe to call from any thread, though the answer may be out of date.
+    bool empty() const {
+        size_t position = head.load(std::memory_order_acquire);
+        return cells[position & mask].sequence.load(std::memory_order_acquire) != position + 1;
+    }
+
+    // Passes up to max_count values to func in FIFO order and returns how many
+    // there were. Only one thread may receive at a time.
+    template <typename Func>
+    size_t consume(Func&& func, size_t max_count) {
+        size_t position = head.load(std::memory_order_relaxed);
+        size_t count{};
+        for(; count < max_count; ++count) {
+            Cell& cell = cells[position & mask];
+            if(cell.sequence.load(std::memory_order_acquire) != position + 1) {
+                break; // Empty, or the sender hasn't finished writing.
+            }
+            func(*cell.value);
+            cell.value.reset();
+            cell.sequence.store(position + cells.size(), std::memory_order_release);
+            ++position;
+        }
+        head.store(position, std::memory_order_release);
+        return count;
+    }
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+// A message as it was sent. It's created once and shared by everyone who
+// receives it, rather than copied into each of their logs, and is only
+// formatted for a recipient when their log is rendered.
+class Message {
+    std::string origin;
+    std::string text;
+public:
+    Message(const std::string& origin, const std::string& text)
+    : origin(origin), text(text) {}
+
+    const std::string& get_origin() const {
+        return origin;
+    }
+    const std::string& get_text() const {
+        return text;
+    }
+
+    std::string format(const std::string& recipient) const {
+        return "[" + origin + "->" + recipient + "] " + text;
+    }
+};
+
+using MessagePtr = std::shared_ptr<const Message>;
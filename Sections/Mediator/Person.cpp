@@ -1,5 +1,5 @@
-#include <iostream>
 #include "Person.h"
+#include "AsyncLogger.h"
 #include "Chatroom.h"
 
 Person::Person(const std::string &name) : name(name) {
@@ -14,19 +14,36 @@ void Person::set_room(std::shared_ptr<Chatroom> room) {
     this->room = room;
 }
 
+void Person::set_logging(bool logging) {
+    this->logging = logging;
+}
+
+const std::vector<MessagePtr>& Person::get_chat_log() const {
+    return chat_log;
+}
+
+void Person::render_chat_log(std::ostream& os) const {
+    for(const auto& message : chat_log) {
+        os << message->format(name) << '\n';
+    }
+}
+
 void Person::say(const std::string& message) {
-    receive(name, message); // Store record of sent message.
-    room->broadcast(name, message);
+    auto record = std::make_shared<const Message>(name, message);
+    room->deliver(shared_from_this(), record); // Store record of sent message.
+    room->broadcast(record);
 }
 
 void Person::private_message(const std::string& who, const std::string& message) {
-    receive(name, message);
-    room->message(name, who, message);
+    auto record = std::make_shared<const Message>(name, message);
+    room->deliver(shared_from_this(), record);
+    room->message(who, record);
 }
 
-void Person::receive(const std::string& origin, const std::string& message) {
-    std::string output = "[" + origin + "->" + name + "] " + message;
-    std::cout << output << std::endl;
-    chat_log.emplace_back(output);
+void Person::receive(const MessagePtr& message) {
+    if(logging) {
+        console_logger().log(message->format(name));
+    }
+    chat_log.push_back(message);
 }
 
@@ -2,23 +2,43 @@
 
 #include <string>
 #include <memory>
+#include <atomic>
+#include <ostream>
 #include <vector>
+#include "Mailbox.h"
+#include "Message.h"
 
 class Chatroom;
 
-class Person {
+// Must be created with make_shared. In a room with a dispatcher, messages
+// are delivered through the person's mailbox, and the room drains it on the
+// dispatcher's threads, so receive() runs for one message at a time.
+class Person : public std::enable_shared_from_this<Person> {
+    friend class Chatroom;
+
     std::string name;
     std::shared_ptr<Chatroom> room;
-    std::vector<std::string> chat_log;
+    std::vector<MessagePtr> chat_log;
+    bool logging{true};
+    std::unique_ptr<Mailbox<MessagePtr>> mailbox;
+    // Whether a drain of the mailbox is queued or running. Whoever sets it
+    // schedules the drain, and the drain clears it when it's done.
+    std::atomic<bool> scheduled{false};
+    // Where the room keeps this person, so leaving is O(1).
+    size_t shard{}, slot{};
 public:
     Person(const std::string &name);
 
     const std::string& get_name() const;
     void set_room(std::shared_ptr<Chatroom> room);
+    // Whether received messages are written to the console_logger().
+    void set_logging(bool logging);
+    const std::vector<MessagePtr>& get_chat_log() const;
+    // Formats the log, one message per line.
+    void render_chat_log(std::ostream& os) const;
 
     void say(const std::string& message);
     void private_message(const std::string& who,
                          const std::string& message);
-    void receive(const std::string& origin,
-                 const std::string& message);
-};
\ No newline at end of file
+    void receive(const MessagePtr& message);
+};
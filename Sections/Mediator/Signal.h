@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename>
+class Delegate;
+
+// Callable stored inline rather than on the heap like std::function, so
+// creating, copying and calling one never allocates. Callables bigger than
+// capacity, e.g. lambdas capturing a lot by value, don't compile; capture a
+// pointer instead.
+template <typename R, typename...Args>
+class Delegate<R(Args...)> {
+public:
+    static constexpr size_t capacity{4 * sizeof(void*)};
+private:
+    enum class Operation {copy, move, destroy};
+
+    // Mutable, as std::function lets a const call run a mutable lambda.
+    alignas(std::max_align_t) mutable unsigned char storage[capacity];
+    R (*invoke)(void* callable, Args...args) {};
+    void (*manage)(Operation operation, void* target, void* source) {};
+
+    template <typename F>
+    static R invoke_callable(void* callable, Args...args) {
+        return (*static_cast<F*>(callable))(std::forward<Args>(args)...);
+    }
+    template <typename F>
+    static void manage_callable(Operation operation, void* target, void* source) {
+        switch(operation) {
+            case Operation::copy: {
+                new (target) F(*static_cast<const F*>(source));
+                break;
+            }
+            case Operation::move: {
+                new (target) F(std::move(*static_cast<F*>(source)));
+                static_cast<F*>(source)->~F();
+                break;
+            }
+            case Operation::destroy: {
+                static_cast<F*>(target)->~F();
+                break;
+            }
+        }
+    }
+public:
+    Delegate() = default;
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Delegate>>>
+    Delegate(F&& callable) {
+        using Callable = std::decay_t<F>;
+        static_assert(sizeof(Callable) <= capacity, "Callable is too big for a Delegate");
+        static_assert(alignof(Callable) <= alignof(std::max_align_t), "Callable is over-aligned");
+        new (storage) Callable(std::forward<F>(callable));
+        invoke = &invoke_callable<Callable>;
+        manage = &manage_callable<Callable>;
+    }
+    Delegate(const Delegate& other) : invoke{other.invoke}, manage{other.manage} {
+        if(manage) {
+            manage(Operation::copy, storage, other.storage);
+        }
+    }
+    Delegate(Delegate&& other) noexcept : invoke{other.invoke}, manage{other.manage} {
+        if(manage) {
+            manage(Operation::move, storage, other.storage);
+            other.invoke = nullptr;
+            other.manage = nullptr;
+        }
+    }
+    Delegate& operator=(const Delegate& other) {
+        if(this != &other) {
+            *this = Delegate{other};
+        }
+        return *this;
+    }
+    Delegate& operator=(Delegate&& other) noexcept {
+        if(this != &other) {
+            reset();
+            invoke = other.invoke;
+            manage = other.manage;
+            if(manage) {
+                manage(Operation::move, storage, other.storage);
+                other.invoke = nullptr;
+                other.manage = nullptr;
+            }
+        }
+        return *this;
+    }
+    ~Delegate() {
+        reset();
+    }
+
+    void reset() {
+        if(manage) {
+            manage(Operation::destroy, storage, nullptr);
+            invoke = nullptr;
+            manage = nullptr;
+        }
+    }
+
+    explicit operator bool() const {
+        return invoke != nullptr;
+    }
+    R operator()(Args...args) const {
+        return invoke(storage, std::forward<Args>(args)...);
+    }
+};
+
+template <typename>
+class Signal;
+
+// Handlers are Delegates stored contiguously, so emitting is a walk over one
+// array with no allocations and no pointer chasing through std::function's
+// heap storage. Events can be passed by reference rather than in a
+// shared_ptr, e.g. Signal<void(const PlayerScoredData&)>.
+template <typename R, typename...Args>
+class Signal<R(Args...)> {
+    struct Slot {
+        Delegate<R(Args...)> func;
+        size_t id;
+    };
+    std::vector<Slot> slots;
+    size_t next_id{};
+public:
+    using Connection = size_t;
+
+    void operator()(const Args&...args) const {
+        for(const auto& slot : slots) {
+            slot.func(args...);
+        }
+    }
+
+    Connection connect(Delegate<R(Args...)> func) {
+        slots.push_back(Slot{std::move(func), next_id});
+        return next_id++;
+    }
+    // Handlers may be reordered.
+    void disconnect(Connection connection) {
+        for(auto& slot : slots) {
+            if(slot.id == connection) {
+                slot = std::move(slots.back());
+                slots.pop_back();
+                return;
+            }
+        }
+    }
+
+    size_t size() const {
+        return slots.size();
+    }
+};
@@ -3,57 +3,52 @@
 #include <string>
 #include <iostream>
 #include <memory>
-#include <functional>
+#include <string_view>
+#include <vector>
+#include "EventBus.h"
 
-template <typename>
-class Signal;
-
-template <typename R, typename...Args>
-class Signal<R(Args...)> {
-    using types = R(Args...); // TODO: Not using return type. Remove?
-    std::vector<std::function<types>> funcs;
-public:
-    void operator()(const Args&...args) {
-        for(const auto& func : funcs) {
-            func(args...);
-        }
-    }
-
-    void connect(const std::function<types>& func) {
-        funcs.push_back(func);
-    }
-};
-
-class EventData {
-public:
-    virtual void print() const = 0;
-};
-
-class PlayerScoredData : public EventData {
-    std::string player_name;
+// Events are passed by reference for the duration of their publication, so
+// they can refer to the player's name rather than copying it. They don't need
+// a common base, the event bus dispatches on their type.
+class PlayerScoredData {
+    std::string_view player_name;
     int goals_scored {};
 public:
-    PlayerScoredData(const std::string& player_name, int goals_scored)
+    PlayerScoredData(std::string_view player_name, int goals_scored)
     : player_name(player_name), goals_scored(goals_scored) {
 
     }
 
-    const std::string &get_name() const {
+    std::string_view get_name() const {
         return player_name;
     }
     int get_goals() const {
         return goals_scored;
     }
 
-    void print() const override {
+    void print() const {
         std::cout << player_name << " has scored " << goals_scored << " goals." << std::endl;
     }
 };
 
+class PlayerSentOffData {
+    std::string_view player_name;
+public:
+    PlayerSentOffData(std::string_view player_name) : player_name(player_name) {}
+
+    std::string_view get_name() const {
+        return player_name;
+    }
+
+    void print() const {
+        std::cout << player_name << " has been sent off." << std::endl;
+    }
+};
+
 // Mediator that ties different components together with 'event handling'/'observer pattern'.
 class Game {
 public:
-    Signal<void(std::shared_ptr<EventData>)> events;
+    EventBus<PlayerScoredData, PlayerSentOffData> events;
 };
 
 class Player {
@@ -66,24 +61,41 @@ public:
 
     void score() {
         ++goals_scored;
-        auto data = std::make_shared<PlayerScoredData>(name, goals_scored);
-        game->events(data); // Signals that an event has occurred.
+        game->events.publish(PlayerScoredData{name, goals_scored}); // Signals that an event has occurred.
+    }
+    void send_off() {
+        game->events.publish(PlayerSentOffData{name});
     }
 };
 
 class Coach {
     std::shared_ptr<Game> game;
+    std::vector<EventBus<PlayerScoredData, PlayerSentOffData>::Connection> connections;
 public:
     Coach(std::shared_ptr<Game> game) : game(game) {
-        auto fp = std::bind(&Coach::player_scored, *this, std::placeholders::_1);
-        game->events.connect(fp);
+        connections.push_back(game->events.subscribe<PlayerScoredData>([this](const PlayerScoredData& data) {
+            player_scored(data);
+        }));
+        connections.push_back(game->events.subscribe<PlayerSentOffData>([this](const PlayerSentOffData& data) {
+            player_sent_off(data);
+        }));
+    }
+    // The game refers to this coach until it's destroyed.
+    Coach(const Coach&) = delete;
+    Coach& operator=(const Coach&) = delete;
+    ~Coach() {
+        for(auto connection : connections) {
+            game->events.unsubscribe(connection);
+        }
     }
 
-    void player_scored(std::shared_ptr<EventData> event_data) {
-        auto player_data = std::dynamic_pointer_cast<PlayerScoredData>(event_data);
-        if(player_data && player_data->get_goals() == 3) {
-            std::cout << "Coach: well done " << player_data->get_name()
+    void player_scored(const PlayerScoredData& data) {
+        if(data.get_goals() == 3) {
+            std::cout << "Coach: well done " << data.get_name()
                       << ". You scored a hat-trick." << std::endl;
         }
     }
-};
\ No newline at end of file
+    void player_sent_off(const PlayerSentOffData& data) {
+        std::cout << "Coach: " << data.get_name() << ", what were you thinking?" << std::endl;
+    }
+};
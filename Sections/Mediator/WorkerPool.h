@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run posted tasks, one task at a time each, so a
+// job split into several tasks is spread across all of them.
+class WorkerPool {
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+    size_t busy{}; // Workers running a task.
+    bool stopping{false};
+
+    void run() {
+        std::unique_lock lock{mutex};
+        while(true) {
+            wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if(tasks.empty()) { // Stopping, and everything's been run.
+                return;
+            }
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            ++busy;
+            lock.unlock();
+            task();
+            lock.lock();
+            --busy;
+            if(busy == 0 && tasks.empty()) {
+                idle.notify_all();
+            }
+        }
+    }
+public:
+    explicit WorkerPool(size_t thread_count = std::thread::hardware_concurrency()) {
+        for(size_t i{}; i < std::max<size_t>(thread_count, 1); ++i) {
+            workers.emplace_back(&WorkerPool::run, this);
+        }
+    }
+    // Runs anything still queued before returning.
+    ~WorkerPool() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& worker : workers) {
+            worker.join();
+        }
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard lock{mutex};
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+    // Waits until everything posted so far has run.
+    void wait_idle() {
+        std::unique_lock lock{mutex};
+        idle.wait(lock, [this]() { return busy == 0 && tasks.empty(); });
+    }
+};
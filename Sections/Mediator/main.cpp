@@ -1,4 +1,10 @@
 #include <iostream>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <utility>
+#include <vector>
+#include "AsyncLogger.h"
 #include "Chatroom.h"
 #include "SportingMatch.h"
 
@@ -16,6 +22,165 @@ void create_chatroom() {
     room->join(simon);
     simon->say("Hi everyone.");
     john->private_message("Simon", "Glad you found us.");
+
+    console_logger().flush();
+    std::cout << "Simon's log:" << std::endl;
+    simon->render_chat_log(std::cout);
+}
+
+void large_chatroom() {
+    using namespace std::chrono;
+    const int member_count{100'000}, private_messages{2'000};
+    auto room = std::make_shared<Chatroom>();
+    std::vector<std::shared_ptr<Person>> people;
+    for(int i{}; i < member_count; ++i) {
+        people.push_back(std::make_shared<Person>("Member" + std::to_string(i)));
+        people.back()->set_logging(false);
+        room->join(people.back(), false);
+    }
+
+    // As private messages used to be routed, comparing every member's name.
+    auto start = steady_clock::now();
+    size_t scanned{};
+    for(int i{}; i < private_messages; ++i) {
+        std::string who = "Member" + std::to_string(i * 50'021 % member_count);
+        for(const auto& person : people) {
+            ++scanned;
+            if(person->get_name() == who) {
+                break;
+            }
+        }
+    }
+    auto scan_time = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+    start = steady_clock::now();
+    for(int i{}; i < private_messages; ++i) {
+        room->message("Member0", "Member" + std::to_string(i * 50'021 % member_count), "Hello");
+    }
+    auto index_time = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+    start = steady_clock::now();
+    people.front()->say("Hello everyone");
+    auto broadcast_time = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+    std::cout << private_messages << " private messages in a room of " << member_count
+              << " took " << scan_time << "ms to find by scanning (" << scanned / private_messages
+              << " names compared per message) and " << index_time << "ms through the index"
+              << std::endl << "A broadcast to " << room->get_shard_count() << " shards took "
+              << broadcast_time << "us and every member shares the sender's record: "
+              << std::boolalpha
+              << (people.back()->get_chat_log().back() == people.front()->get_chat_log().back())
+              << std::endl;
+}
+
+// Visitors come and go from a busy room. Half of those who go leave, the
+// rest are just destroyed, and the room compacts them away.
+void chatroom_churn() {
+    using namespace std::chrono;
+    const int resident_count{10'000}, visitor_count{200'000};
+    const size_t present_visitors{1'000};
+    auto room = std::make_shared<Chatroom>(1024);
+    std::vector<std::shared_ptr<Person>> residents, visitors;
+    for(int i{}; i < resident_count; ++i) {
+        residents.push_back(std::make_shared<Person>("Resident" + std::to_string(i)));
+        residents.back()->set_logging(false);
+        room->join(residents.back(), false);
+    }
+
+    std::mt19937 random;
+    size_t most_held{};
+    auto start = steady_clock::now();
+    for(int i{}; i < visitor_count; ++i) {
+        visitors.push_back(std::make_shared<Person>("Visitor" + std::to_string(i)));
+        visitors.back()->set_logging(false);
+        room->join(visitors.back(), false);
+        if(visitors.size() > present_visitors) {
+            size_t going = random() % visitors.size();
+            if(random() % 2 == 0) {
+                room->leave(visitors[going]);
+            }
+            visitors[going] = std::move(visitors.back());
+            visitors.pop_back();
+        }
+        if(i % 1'000 == 0) {
+            residents.front()->say("Still here?");
+        }
+        most_held = std::max(most_held, room->get_member_count());
+    }
+    auto time = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+    // Everyone present receives this once, including its sender.
+    auto count_messages = [&]() {
+        std::vector<size_t> counts;
+        for(const auto* group : {&residents, &visitors}) {
+            for(const auto& person : *group) {
+                counts.push_back(person->get_chat_log().size());
+            }
+        }
+        return counts;
+    };
+    auto before = count_messages();
+    residents.front()->say("Goodbye");
+    auto after = count_messages();
+    bool once = std::equal(before.begin(), before.end(), after.begin(),
+                           [](size_t before, size_t after) { return after == before + 1; });
+
+    std::cout << visitor_count << " visitors came and went in " << time << "ms" << std::endl
+              << "The room held at most " << most_held << " members for "
+              << resident_count + present_visitors << " present, and now holds "
+              << room->get_member_count() << " for " << residents.size() + visitors.size()
+              << std::endl << "The last broadcast reached everyone once: "
+              << std::boolalpha << once << std::endl;
+}
+
+// Only meaningful in an optimised build.
+void mailbox_benchmark() {
+    using namespace std::chrono;
+    WorkerPool dispatcher;
+    auto fill = [](Chatroom& room, int member_count) {
+        std::vector<std::shared_ptr<Person>> people;
+        for(int i{}; i < member_count; ++i) {
+            people.push_back(std::make_shared<Person>("Member" + std::to_string(i)));
+            people.back()->set_logging(false);
+            room.join(people.back(), false);
+        }
+        return people;
+    };
+
+    for(int member_count : {10, 100, 1'000, 10'000}) {
+        auto room = std::make_shared<Chatroom>();
+        room->set_dispatcher(&dispatcher);
+        auto people = fill(*room, member_count);
+        const int messages = std::max(10, 2'000'000 / member_count);
+        auto start = steady_clock::now();
+        for(int i{}; i < messages; ++i) {
+            people.front()->say("Hello");
+        }
+        auto send_time = duration_cast<milliseconds>(steady_clock::now() - start).count();
+        room->flush();
+        duration<double> time = steady_clock::now() - start;
+        double deliveries = static_cast<double>(messages) * member_count;
+        std::cout << member_count << " members: " << static_cast<long long>(deliveries / time.count())
+                  << " messages/s, the sender was done after " << send_time << "ms of "
+                  << duration_cast<milliseconds>(time).count() << "ms" << std::endl;
+    }
+
+    // Small mailboxes that drop messages rather than hold up the sender.
+    const int member_count{100}, messages{10'000};
+    auto room = std::make_shared<Chatroom>();
+    room->set_dispatcher(&dispatcher, 8, Chatroom::Overflow::drop);
+    auto people = fill(*room, member_count);
+    for(int i{}; i < messages; ++i) {
+        people.front()->say("Hello");
+    }
+    room->flush();
+    size_t received{};
+    for(const auto& person : people) {
+        received += person->get_chat_log().size();
+    }
+    std::cout << "With mailboxes of 8 that drop when full, " << received << " of "
+              << messages * member_count << " messages were received and "
+              << room->get_dropped() << " dropped" << std::endl;
 }
 
 void score_goals() {
@@ -25,12 +190,178 @@ void score_goals() {
     player.score();
     player.score();
     player.score();
+    player.send_off();
+}
+
+// Events as they were published before the event bus, through a common base
+// that every handler receives and casts down from.
+struct LegacyEvent {
+    virtual ~LegacyEvent() = default;
+};
+struct LegacyScoredData : LegacyEvent {
+    std::string name;
+    int goals;
+
+    LegacyScoredData(const std::string& name, int goals) : name(name), goals(goals) {}
+};
+
+// Only meaningful in an optimised build.
+void signal_benchmark() {
+    using namespace std::chrono;
+    const int events{1'000'000}, handler_count{10};
+    // Enough state that std::function has to put each handler on the heap.
+    struct Tally {
+        long long goals{}, events{};
+        int hat_tricks{};
+    } tally;
+    long long* goals = &tally.goals;
+    long long* seen = &tally.events;
+    int* hat_tricks = &tally.hat_tricks;
+
+    // std::function handlers, with a shared_ptr and a dynamic_pointer_cast per event.
+    std::vector<std::function<void(std::shared_ptr<LegacyEvent>)>> functions;
+    for(int i{}; i < handler_count; ++i) {
+        functions.emplace_back([goals, seen, hat_tricks](std::shared_ptr<LegacyEvent> event) {
+            auto data = std::dynamic_pointer_cast<LegacyScoredData>(event);
+            if(data) {
+                *goals += data->goals;
+                *hat_tricks += data->goals == 3;
+            }
+            ++*seen;
+        });
+    }
+    auto start = steady_clock::now();
+    for(int i{}; i < events; ++i) {
+        auto data = std::make_shared<LegacyScoredData>("Sam", i % 4);
+        for(const auto& function : functions) {
+            function(data);
+        }
+    }
+    auto function_time = duration_cast<milliseconds>(steady_clock::now() - start).count();
+    auto function_tally = tally;
+
+    // Signal handlers, with the event on the stack passed by reference.
+    tally = Tally{};
+    Signal<void(const PlayerScoredData&)> signal;
+    for(int i{}; i < handler_count; ++i) {
+        signal.connect([goals, seen, hat_tricks](const PlayerScoredData& data) {
+            *goals += data.get_goals();
+            *hat_tricks += data.get_goals() == 3;
+            ++*seen;
+        });
+    }
+    start = steady_clock::now();
+    for(int i{}; i < events; ++i) {
+        PlayerScoredData data{"Sam", i % 4};
+        signal(data);
+    }
+    auto signal_time = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+    std::cout << events << " events to " << handler_count << " handlers took "
+              << function_time << "ms with std::function and "
+              << signal_time << "ms with Signal" << std::endl
+              << "Both counted the same goals: " << std::boolalpha
+              << (function_tally.goals == tally.goals &&
+                  function_tally.hat_tricks == tally.hat_tricks &&
+                  function_tally.events == tally.events) << std::endl;
+}
+
+template <int N>
+struct NumberedEvent {
+    int value;
+};
+template <int N>
+struct LegacyNumberedEvent : LegacyEvent {
+    int value;
+
+    LegacyNumberedEvent(int value) : value(value) {}
+};
+
+// An event bus over NumberedEvent<0>...NumberedEvent<N-1>.
+template <typename>
+struct NumberedEvents;
+template <int...N>
+struct NumberedEvents<std::integer_sequence<int, N...>> {
+    using Bus = EventBus<NumberedEvent<N>...>;
+    using LegacyHandlers = std::vector<std::function<void(std::shared_ptr<LegacyEvent>)>>;
+
+    static void subscribe(Bus& bus, int handlers_per_type, long long* total) {
+        for(int i{}; i < handlers_per_type; ++i) {
+            (bus.template subscribe<NumberedEvent<N>>([total](const NumberedEvent<N>& event) {
+                *total += event.value;
+            }), ...);
+        }
+    }
+    // Publishes an event of each type.
+    static void publish(const Bus& bus, int value) {
+        (bus.publish(NumberedEvent<N>{value}), ...);
+    }
+
+    // Every handler receives every event, and casts to see if it's its type.
+    static void subscribe(LegacyHandlers& handlers, int handlers_per_type, long long* total) {
+        for(int i{}; i < handlers_per_type; ++i) {
+            (handlers.emplace_back([total](std::shared_ptr<LegacyEvent> event) {
+                if(auto data = std::dynamic_pointer_cast<LegacyNumberedEvent<N>>(event)) {
+                    *total += data->value;
+                }
+            }), ...);
+        }
+    }
+    static void publish(const LegacyHandlers& handlers, int value) {
+        auto publish_one = [&](std::shared_ptr<LegacyEvent> event) {
+            for(const auto& handler : handlers) {
+                handler(event);
+            }
+        };
+        (publish_one(std::make_shared<LegacyNumberedEvent<N>>(value)), ...);
+    }
+};
+
+// Only meaningful in an optimised build.
+void event_bus_benchmark() {
+    using namespace std::chrono;
+    constexpr int type_count{200};
+    const int handlers_per_type{10}, rounds{50};
+    using Events = NumberedEvents<std::make_integer_sequence<int, type_count>>;
+
+    long long legacy_total{};
+    Events::LegacyHandlers handlers;
+    Events::subscribe(handlers, handlers_per_type, &legacy_total);
+    auto start = steady_clock::now();
+    for(int round{}; round < rounds; ++round) {
+        Events::publish(handlers, round);
+    }
+    auto legacy_time = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+    long long bus_total{};
+    Events::Bus bus;
+    Events::subscribe(bus, handlers_per_type, &bus_total);
+    start = steady_clock::now();
+    for(int round{}; round < rounds; ++round) {
+        Events::publish(bus, round);
+    }
+    auto bus_time = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+    std::cout << rounds * type_count << " events of " << type_count << " types to "
+              << type_count * handlers_per_type << " handlers took " << legacy_time
+              << "ms casting in every handler and " << bus_time << "us with the event bus"
+              << std::endl << "Both handled the same events: " << std::boolalpha
+              << (legacy_total == bus_total) << std::endl;
 }
 
 int main() {
     create_chatroom();
     std::cout << std::endl;
+    large_chatroom();
+    std::cout << std::endl;
+    chatroom_churn();
+    std::cout << std::endl;
+    mailbox_benchmark();
+    std::cout << std::endl;
     score_goals();
+    std::cout << std::endl;
+    signal_benchmark();
+    event_bus_benchmark();
 
     return 0;
 }
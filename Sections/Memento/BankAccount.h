@@ -2,7 +2,10 @@
 
 #include <ostream>
 #include <vector>
-#include <memory>
+#include <optional>
+#include "History.h"
+#include "SpillingHistory.h"
+#include "Snapshot.h"
 
 // Memento represents a snapshot of an object at a certain point in time.
 // It should be immutable as a snapshot by definition shouldn't be changed.
@@ -38,56 +41,111 @@ public:
     }
 };
 
+// A consistent view of a BankAccount2 for other threads. The version
+// increases with every change, including undo and redo.
+struct AccountState {
+    int balance;
+    size_t version;
+};
+
+// Keeps its own history, so it can undo and redo. The history is bounded by
+// depth, see DeltaHistory, so old states are eventually forgotten.
+// Changes must all be made from one thread, but get_state() may be called
+// from any thread at the same time.
 class BankAccount2 {
     friend std::ostream& operator<<(std::ostream& os, const BankAccount2& account) {
-        os << "Balance: " << account.balance;
+        os << "Balance: " << account.history.get_current();
         return os;
     }
 
-    int balance{};
-    std::vector<std::shared_ptr<Memento>> changes;
-    size_t current_memento_idx;
+    DeltaHistory<int> history;
+    size_t version{};
+    SeqLock<AccountState> state;
 
-    std::shared_ptr<Memento> add_memento() {
-        auto memento = std::make_shared<Memento>(balance);
-        changes.push_back(memento);
-        ++current_memento_idx;
-        return memento;
+    void publish() {
+        state.store({history.get_current(), ++version});
     }
 public:
-    BankAccount2(int balance) : balance(balance) {
-        changes.emplace_back(std::make_shared<Memento>(balance));
-        current_memento_idx = 0;
+    BankAccount2(int balance, size_t depth = 1024, size_t checkpoint_interval = 64)
+        : history{balance, depth, checkpoint_interval}, state{{balance, 0}} {}
+
+    // Never blocks the thread making changes.
+    AccountState get_state() const {
+        return state.load();
+    }
+
+    int get_balance() const {
+        return history.get_current();
+    }
+    const DeltaHistory<int>& get_history() const {
+        return history;
     }
 
-    void restore(const std::shared_ptr<Memento>& memento) {
-        if(memento) {
-            balance = memento->get_balance();
-            changes.push_back(memento);
-            current_memento_idx = changes.size()-1;
+    // Restoring is recorded like any other change, so it can be undone.
+    void restore(const Memento& memento) {
+        history.record(memento.get_balance());
+        publish();
+    }
+    std::optional<Memento> undo() {
+        if(history.undo()) {
+            publish();
+            return Memento{history.get_current()};
         }
+        return {};
     }
-    std::shared_ptr<Memento> undo() {
-        if(current_memento_idx > 0) {
-            --current_memento_idx;
-            auto memento = changes[current_memento_idx];
-            balance = memento->get_balance();
-            return memento;
+    std::optional<Memento> redo() {
+        if(history.redo()) {
+            publish();
+            return Memento{history.get_current()};
         }
         return {};
     }
-    std::shared_ptr<Memento> redo() {
-        if(current_memento_idx + 1 < changes.size()) {
-            ++current_memento_idx;
-            auto memento = changes[current_memento_idx];
-            balance = memento->get_balance();
-            return memento;
+
+    Memento deposit(int amount) {
+        history.record(history.get_current() + amount);
+        publish();
+        return {history.get_current()};
+    }
+};
+
+// Like BankAccount2, but its history is unbounded and spills to a file once
+// it's outgrown the memory budget, see SpillingHistory.
+class BankAccount3 {
+    friend std::ostream& operator<<(std::ostream& os, const BankAccount3& account) {
+        os << "Balance: " << account.history.get_current();
+        return os;
+    }
+
+    SpillingHistory<int> history;
+public:
+    BankAccount3(int balance, const std::string& path, size_t memory_budget = 1 << 16)
+        : history{balance, path, memory_budget} {}
+
+    int get_balance() const {
+        return history.get_current();
+    }
+    const SpillingHistory<int>& get_history() const {
+        return history;
+    }
+
+    void restore(const Memento& memento) {
+        history.record(memento.get_balance());
+    }
+    std::optional<Memento> undo() {
+        if(history.undo()) {
+            return Memento{history.get_current()};
+        }
+        return {};
+    }
+    std::optional<Memento> redo() {
+        if(history.redo()) {
+            return Memento{history.get_current()};
         }
         return {};
     }
 
-    std::shared_ptr<Memento> deposit(int amount) {
-        balance += amount;
-        return add_memento();
+    Memento deposit(int amount) {
+        history.record(history.get_current() + amount);
+        return {history.get_current()};
     }
 };
\ No newline at end of file
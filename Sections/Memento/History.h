@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+
+// Bounded undo/redo history of a value that supports + and -, e.g. a balance.
+// Rather than a snapshot per state it stores the difference from the previous
+// state, in a ring buffer of at most depth entries, so recording, undo and redo
+// are O(1) and allocation free. Once full, the oldest states are forgotten.
+// Every checkpoint_interval states a full copy of the state is kept as well,
+// so any retained state can be recovered from at most that many differences.
+// States are numbered from 0 in the order they were recorded.
+template <typename T>
+class DeltaHistory {
+    std::vector<T> deltas; // deltas[i % depth] is state i minus state i-1.
+    std::vector<T> checkpoints; // checkpoints[(i / interval) % size] is state i.
+    const size_t checkpoint_interval;
+    T oldest; // Value of the state first.
+    T current;
+    size_t first{}, position{}, last{}; // Oldest, current and newest states.
+
+    T& delta(size_t state) {
+        return deltas[state % deltas.size()];
+    }
+    T& checkpoint(size_t state) {
+        return checkpoints[(state / checkpoint_interval) % checkpoints.size()];
+    }
+    // Called from the first member initialiser, so the others never see bad arguments.
+    static size_t checked(size_t depth, size_t checkpoint_interval) {
+        if(depth == 0 || checkpoint_interval == 0) {
+            throw std::invalid_argument("Depth and checkpoint interval must be at least 1");
+        }
+        return depth;
+    }
+public:
+    DeltaHistory(const T& initial, size_t depth, size_t checkpoint_interval)
+        : deltas(checked(depth, checkpoint_interval)),
+          // Enough to cover depth+1 states wherever they start.
+          checkpoints(depth / checkpoint_interval + 2),
+          checkpoint_interval{checkpoint_interval},
+          oldest{initial}, current{initial} {
+        checkpoint(0) = initial;
+    }
+
+    const T& get_current() const {
+        return current;
+    }
+    size_t get_position() const {
+        return position;
+    }
+    size_t get_first() const {
+        return first;
+    }
+    size_t get_last() const {
+        return last;
+    }
+
+    // Discards any states that could be redone.
+    void record(const T& value) {
+        ++position;
+        last = position;
+        if(last - first > deltas.size()) {
+            // Full, the delta about to be overwritten leads to the oldest but one
+            // state, which becomes the oldest.
+            ++first;
+            oldest += delta(first);
+        }
+        delta(position) = value - current;
+        current = value;
+        if(position % checkpoint_interval == 0) {
+            checkpoint(position) = value;
+        }
+    }
+    bool undo() {
+        if(position == first) {
+            return false;
+        }
+        current -= delta(position);
+        --position;
+        return true;
+    }
+    bool redo() {
+        if(position == last) {
+            return false;
+        }
+        ++position;
+        current += delta(position);
+        return true;
+    }
+
+    // Value of any retained state, replaying at most checkpoint_interval deltas.
+    T value_at(size_t state) {
+        if(state < first || state > last) {
+            throw std::out_of_range("State isn't in the history");
+        }
+        size_t from = state - state % checkpoint_interval;
+        T value;
+        if(from <= first) {
+            from = first;
+            value = oldest;
+        } else {
+            value = checkpoint(from);
+        }
+        for(size_t i{from + 1}; i <= state; ++i) {
+            value += delta(i);
+        }
+        return value;
+    }
+
+    size_t memory_usage() const {
+        return sizeof(*this) + (deltas.capacity() + checkpoints.capacity()) * sizeof(T);
+    }
+};
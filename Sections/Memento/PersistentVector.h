@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <stdexcept>
+
+// Immutable vector where every "modification" returns a new vector that shares
+// all unchanged structure with the old one. Elements are stored in a trie with
+// 32 children per node, so push_back() and set() copy only the O(log n) nodes
+// on the path to the element, and copying the vector itself is O(1). That
+// makes it cheap to keep a snapshot of every version.
+template <typename T>
+class PersistentVector {
+    static constexpr size_t bits{5};
+    static constexpr size_t width{1 << bits};
+    static constexpr size_t mask{width - 1};
+
+    struct Node {
+        std::vector<std::shared_ptr<const Node>> children; // Internal nodes.
+        std::vector<T> values; // Leaves.
+    };
+    using NodePtr = std::shared_ptr<const Node>;
+
+    NodePtr root;
+    size_t count{};
+    size_t shift{}; // bits * levels above the leaves.
+
+    PersistentVector(NodePtr root, size_t count, size_t shift)
+        : root{std::move(root)}, count{count}, shift{shift} {}
+
+    // Copies the path to index, or creates it if it doesn't exist yet.
+    static NodePtr push(const NodePtr& node, size_t level, size_t index, const T& value) {
+        auto copy = node ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+        if(level == 0) {
+            copy->values.push_back(value);
+        } else {
+            size_t child = (index >> level) & mask;
+            if(child == copy->children.size()) {
+                copy->children.emplace_back();
+            }
+            copy->children[child] = push(copy->children[child], level - bits, index, value);
+        }
+        return copy;
+    }
+    static NodePtr assign(const NodePtr& node, size_t level, size_t index, const T& value) {
+        auto copy = std::make_shared<Node>(*node);
+        if(level == 0) {
+            copy->values[index & mask] = value;
+        } else {
+            size_t child = (index >> level) & mask;
+            copy->children[child] = assign(copy->children[child], level - bits, index, value);
+        }
+        return copy;
+    }
+public:
+    PersistentVector() = default;
+
+    size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        const Node* node = root.get();
+        for(size_t level{shift}; level > 0; level -= bits) {
+            node = node->children[(index >> level) & mask].get();
+        }
+        return node->values[index & mask];
+    }
+    const T& at(size_t index) const {
+        if(index >= count) {
+            throw std::out_of_range("Index out of range");
+        }
+        return (*this)[index];
+    }
+
+    PersistentVector push_back(const T& value) const {
+        if(!root) {
+            return {push(nullptr, 0, 0, value), 1, 0};
+        }
+        if(count == (width << shift)) { // Full, add a level above the root.
+            auto new_root = std::make_shared<Node>();
+            new_root->children.push_back(root);
+            return {push(new_root, shift + bits, count, value), count + 1, shift + bits};
+        }
+        return {push(root, shift, count, value), count + 1, shift};
+    }
+    PersistentVector set(size_t index, const T& value) const {
+        if(index >= count) {
+            throw std::out_of_range("Index out of range");
+        }
+        return {assign(root, shift, index, value), count, shift};
+    }
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+// Publishes a small value from one writer thread to any number of reader
+// threads without either side locking. The writer bumps a sequence number
+// before and after each store; a reader retries if the number was odd or
+// changed while it copied, so it always sees a complete value. The writer
+// never waits for readers.
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T>, "Values are copied as raw bytes");
+    static constexpr size_t words{(sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t)};
+
+    std::atomic<uint64_t> sequence{};
+    // Atomic words, so that reading during a store isn't a data race.
+    std::array<std::atomic<uint64_t>, words> data{};
+public:
+    explicit SeqLock(const T& value = {}) {
+        store(value);
+    }
+
+    // Only one thread may store at a time.
+    void store(const T& value) {
+        uint64_t buffer[words]{};
+        std::memcpy(buffer, &value, sizeof(T));
+        uint64_t current = sequence.load(std::memory_order_relaxed);
+        sequence.store(current + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(size_t i{}; i < words; ++i) {
+            data[i].store(buffer[i], std::memory_order_relaxed);
+        }
+        sequence.store(current + 2, std::memory_order_release);
+    }
+    T load() const {
+        uint64_t buffer[words];
+        uint64_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            for(size_t i{}; i < words; ++i) {
+                buffer[i] = data[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while(before != after || (before & 1));
+        T value;
+        std::memcpy(&value, buffer, sizeof(T));
+        return value;
+    }
+};
+
+// Publishes an immutable value of any size from one writer thread to any
+// number of reader threads, neither side locking. std::atomic_load/store on a
+// shared_ptr aren't an option, as libstdc++ implements them with a pool of
+// mutexes. Instead each version goes in one of a ring of slots, and readers
+// pin the latest slot with a counter while they copy its shared_ptr. The
+// writer stores into a slot that is neither the latest nor pinned, claiming it
+// by swapping its counter from 0 to -1 so that no reader can pin it meanwhile,
+// then makes it the latest. Readers never wait for the writer, as it never
+// claims the latest slot, and only retry when it has published a new version.
+// The writer only waits if readers are pinning every other slot at once.
+// Readers keep whatever version they loaded alive for as long as they need it,
+// so it's best suited to values that are cheap to copy or share structure,
+// such as a PersistentVector.
+template <typename T>
+class SharedSnapshot {
+    static constexpr size_t slot_count{16};
+    static constexpr int claimed{-1};
+
+    struct alignas(64) Slot { // Separate cache lines, as readers write the counters.
+        std::atomic<int> readers{}; // Pinning it, or claimed by the writer.
+        std::shared_ptr<const T> value;
+    };
+
+    mutable std::array<Slot, slot_count> slots; // Readers pin them.
+    std::atomic<size_t> latest{};
+public:
+    explicit SharedSnapshot(const T& value = {}) {
+        slots[0].value = std::make_shared<const T>(value);
+    }
+
+    // Only one thread may store at a time.
+    void store(const T& value) {
+        auto version = std::make_shared<const T>(value);
+        size_t current = latest.load(std::memory_order_relaxed);
+        for(size_t i{(current + 1) % slot_count}; ; i = (i + 1) % slot_count) {
+            if(i == current) {
+                continue;
+            }
+            int expected{};
+            Slot& slot = slots[i];
+            if(slot.readers.compare_exchange_strong(expected, claimed, std::memory_order_acquire,
+                                                    std::memory_order_relaxed)) {
+                slot.value = std::move(version); // Frees the old version, unless a reader has it.
+                slot.readers.store(0, std::memory_order_release);
+                latest.store(i, std::memory_order_release);
+                return;
+            }
+        }
+    }
+    // The latest version. Versions loaded one after another never go back.
+    std::shared_ptr<const T> load() const {
+        while(true) {
+            size_t index = latest.load(std::memory_order_acquire);
+            Slot& slot = slots[index];
+            int readers = slot.readers.load(std::memory_order_relaxed);
+            while(readers != claimed &&
+                  !slot.readers.compare_exchange_weak(readers, readers + 1,
+                                                      std::memory_order_acquire,
+                                                      std::memory_order_relaxed)) {}
+            if(readers == claimed) {
+                continue; // The writer has since claimed it, so latest has moved on.
+            }
+            // Once pinned the slot can't change, but it might have been
+            // rewritten before that with a version that isn't the latest yet.
+            if(latest.load(std::memory_order_acquire) != index) {
+                slot.readers.fetch_sub(1, std::memory_order_release);
+                continue;
+            }
+            std::shared_ptr<const T> value = slot.value;
+            slot.readers.fetch_sub(1, std::memory_order_release);
+            return value;
+        }
+    }
+};
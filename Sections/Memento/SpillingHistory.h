@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Unbounded undo/redo history of a value that supports + and -, kept within a
+// memory budget by spilling states far from the current one to a file.
+// Like DeltaHistory it stores the difference from the previous state. Once
+// the differences in memory exceed the budget, a page of them is appended to
+// the file from whichever end is further from the current state: the oldest
+// states, or after undoing far back, the newest states that could be redone.
+// Undoing or redoing past the states in memory reads the nearest spilled page
+// back in. Paging in, and recording over states that could be redone, leave
+// dead pages behind in the append-only file, so a background thread rewrites
+// the file without them once they outweigh the live pages.
+// The file is scratch space, it's removed when the history is destroyed.
+template <typename T>
+class SpillingHistory {
+    static_assert(std::is_trivially_copyable_v<T>, "Deltas are written to disk as raw bytes");
+
+    const std::string path;
+    const size_t page_size; // Deltas per page.
+    const size_t memory_budget; // In deltas.
+    std::deque<T> deltas; // States older_spilled()+1 to last-newer_spilled().
+    T current;
+    size_t position{}, last{};
+    // Only changed by the history's own thread, the compactor moves pages
+    // around without changing how many there are.
+    size_t older_pages{}, newer_pages{};
+
+    // Shared with the compactor, only modified while holding the mutex.
+    mutable std::mutex mutex;
+    std::fstream file;
+    std::vector<std::streamoff> older; // Spilled pages of the oldest states, oldest first.
+    std::vector<std::streamoff> newer; // Spilled pages of the newest states, newest first.
+    std::streamoff file_size{};
+    size_t compactions{};
+    std::string compaction_error; // From the last failed compaction.
+    bool stopping{false};
+    std::condition_variable wake;
+    std::thread compactor;
+
+    std::streamoff page_bytes() const {
+        return static_cast<std::streamoff>(page_size * sizeof(T));
+    }
+    size_t older_spilled() const {
+        return older_pages * page_size;
+    }
+    size_t newer_spilled() const {
+        return newer_pages * page_size;
+    }
+    T& delta(size_t state) {
+        return deltas[state - older_spilled() - 1];
+    }
+    bool needs_compaction() const {
+        auto live = static_cast<std::streamoff>(older.size() + newer.size()) * page_bytes();
+        auto dead = file_size - live;
+        return dead > live && dead >= 4 * page_bytes();
+    }
+
+    void write_page(const std::vector<T>& page, std::vector<std::streamoff>& pages) {
+        std::lock_guard lock{mutex};
+        file.seekp(file_size);
+        file.write(reinterpret_cast<const char*>(page.data()), page_bytes());
+        file.flush();
+        if(!file) {
+            throw std::runtime_error("Failed to write " + path);
+        }
+        pages.push_back(file_size);
+        file_size += page_bytes();
+    }
+    std::vector<T> read_page(std::vector<std::streamoff>& pages) {
+        std::vector<T> page(page_size);
+        std::lock_guard lock{mutex};
+        file.seekg(pages.back());
+        file.read(reinterpret_cast<char*>(page.data()), page_bytes());
+        if(!file) {
+            throw std::runtime_error("Failed to read " + path);
+        }
+        pages.pop_back();
+        if(needs_compaction()) {
+            wake.notify_one();
+        }
+        return page;
+    }
+
+    // Never spills a page that's within a page of the current state, so
+    // undoing and redoing around it doesn't keep hitting the disk.
+    void spill() {
+        std::vector<T> page(page_size);
+        while(deltas.size() > memory_budget + page_size) {
+            size_t before = position - older_spilled(); // In memory, up to the current state.
+            size_t after = last - newer_spilled() - position; // In memory, after it.
+            if(before >= after && before > 2 * page_size) {
+                std::copy_n(deltas.begin(), page_size, page.begin());
+                write_page(page, older);
+                deltas.erase(deltas.begin(), deltas.begin() + page_size);
+                ++older_pages;
+            } else if(after > 2 * page_size) {
+                std::copy(deltas.end() - page_size, deltas.end(), page.begin());
+                write_page(page, newer);
+                deltas.erase(deltas.end() - page_size, deltas.end());
+                ++newer_pages;
+            } else {
+                break;
+            }
+        }
+    }
+
+    // Copies the live pages to a new file, then swaps it in. Returns an error
+    // message if that fails, leaving the file and the page offsets as they
+    // were.
+    std::string rewrite(std::unique_lock<std::mutex>& lock) {
+        std::vector<std::streamoff> snapshot = older;
+        snapshot.insert(snapshot.end(), newer.begin(), newer.end());
+        std::string compacted_path = path + ".compacted";
+        std::vector<char> page(page_bytes());
+        std::unordered_map<std::streamoff, std::streamoff> moved; // Old offset to new.
+        std::ofstream out{compacted_path, std::ios::binary | std::ios::trunc};
+        lock.unlock();
+
+        // Spilled pages never change and the file is only appended to, so an
+        // offset always refers to the same page and they can be copied while
+        // the history is in use.
+        std::ifstream in{path, std::ios::binary};
+        for(auto offset : snapshot) {
+            in.seekg(offset);
+            in.read(page.data(), page_bytes());
+            moved[offset] = out.tellp();
+            out.write(page.data(), page_bytes());
+        }
+
+        lock.lock();
+        // Pages spilled since the snapshot are copied now.
+        out.seekp(0, std::ios::end);
+        for(auto* pages : {&older, &newer}) {
+            for(auto offset : *pages) {
+                if(moved.count(offset) == 0) {
+                    file.seekg(offset);
+                    file.read(page.data(), page_bytes());
+                    moved[offset] = out.tellp();
+                    out.write(page.data(), page_bytes());
+                }
+            }
+        }
+        auto compacted_size = out.tellp();
+        out.close();
+        in.close();
+        if(!out || !in || !file) {
+            file.clear();
+            std::filesystem::remove(compacted_path);
+            return "Failed to compact " + path;
+        }
+        // The old file stays open until the new one has replaced it, so a
+        // failure anywhere along the way leaves the history as it was.
+        std::fstream compacted{compacted_path, std::ios::binary | std::ios::in | std::ios::out};
+        std::error_code error;
+        if(compacted) {
+            std::filesystem::rename(compacted_path, path, error);
+        }
+        if(!compacted || error) {
+            compacted.close();
+            std::filesystem::remove(compacted_path, error);
+            return "Failed to replace " + path + " with its compacted copy";
+        }
+        file = std::move(compacted);
+        file_size = compacted_size;
+        for(auto* pages : {&older, &newer}) {
+            for(auto& offset : *pages) {
+                offset = moved.at(offset); // Every live page was copied.
+            }
+        }
+        ++compactions;
+        return {};
+    }
+    void compact() {
+        std::unique_lock lock{mutex};
+        while(true) {
+            wake.wait(lock, [this]() { return stopping || needs_compaction(); });
+            if(stopping) {
+                return;
+            }
+            try {
+                compaction_error = rewrite(lock);
+            } catch(const std::exception& e) { // E.g. out of memory.
+                if(!lock.owns_lock()) {
+                    lock.lock();
+                }
+                compaction_error = e.what();
+            }
+            if(!compaction_error.empty()) {
+                // Tries again later, e.g. once there's space on the disk.
+                wake.wait_for(lock, std::chrono::seconds{1}, [this]() { return stopping; });
+            }
+        }
+    }
+public:
+    // memory_budget is in bytes.
+    SpillingHistory(const T& initial, const std::string& path,
+                    size_t memory_budget = 1 << 16, size_t page_size = 512)
+        : path{path}, page_size{std::max<size_t>(page_size, 1)},
+          memory_budget{memory_budget / sizeof(T)}, current{initial},
+          file{path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc} {
+        if(!file) {
+            throw std::runtime_error("Failed to open " + path);
+        }
+        compactor = std::thread{&SpillingHistory::compact, this};
+    }
+    ~SpillingHistory() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        wake.notify_one();
+        compactor.join();
+        file.close();
+        std::filesystem::remove(path);
+    }
+    SpillingHistory(const SpillingHistory&) = delete;
+    SpillingHistory& operator=(const SpillingHistory&) = delete;
+
+    const T& get_current() const {
+        return current;
+    }
+    size_t get_position() const {
+        return position;
+    }
+    size_t get_last() const {
+        return last;
+    }
+
+    // Discards any states that could be redone.
+    void record(const T& value) {
+        deltas.resize(position - older_spilled());
+        if(newer_pages != 0) {
+            std::lock_guard lock{mutex};
+            newer.clear();
+            newer_pages = 0;
+            if(needs_compaction()) {
+                wake.notify_one();
+            }
+        }
+        deltas.push_back(value - current);
+        current = value;
+        last = ++position;
+        spill();
+    }
+    bool undo() {
+        if(position == 0) {
+            return false;
+        }
+        if(position <= older_spilled()) {
+            auto page = read_page(older);
+            deltas.insert(deltas.begin(), page.begin(), page.end());
+            --older_pages;
+        }
+        current -= delta(position);
+        --position;
+        spill();
+        return true;
+    }
+    bool redo() {
+        if(position == last) {
+            return false;
+        }
+        ++position;
+        if(position > last - newer_spilled()) {
+            auto page = read_page(newer);
+            deltas.insert(deltas.end(), page.begin(), page.end());
+            --newer_pages;
+        }
+        current += delta(position);
+        spill();
+        return true;
+    }
+
+    size_t memory_usage() const {
+        std::lock_guard lock{mutex};
+        return deltas.size() * sizeof(T) +
+               (older.capacity() + newer.capacity()) * sizeof(std::streamoff);
+    }
+    size_t disk_usage() const {
+        std::lock_guard lock{mutex};
+        return static_cast<size_t>(file_size);
+    }
+    size_t get_compactions() const {
+        std::lock_guard lock{mutex};
+        return compactions;
+    }
+    // Why the last compaction failed, or empty if it didn't. Failed
+    // compactions are retried.
+    std::string get_compaction_error() const {
+        std::lock_guard lock{mutex};
+        return compaction_error;
+    }
+};
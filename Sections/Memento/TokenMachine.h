@@ -0,0 +1,53 @@
+#pragma once
+
+#include "PersistentVector.h"
+#include "Snapshot.h"
+
+class Token {
+public:
+    int value;
+
+    Token(int value) : value(value) {}
+};
+
+// Snapshot of every token in a TokenMachine. Shares its structure with the
+// machine and with other snapshots, so taking one is O(1) rather than a copy
+// of every token.
+class TokenMemento {
+    const PersistentVector<Token> tokens;
+public:
+    TokenMemento(const PersistentVector<Token>& tokens) : tokens(tokens) {}
+
+    const PersistentVector<Token>& get_tokens() const {
+        return tokens;
+    }
+};
+
+// Tokens must all be added from one thread, but snapshot() may be called from
+// any thread at the same time.
+class TokenMachine {
+    PersistentVector<Token> tokens;
+    SharedSnapshot<PersistentVector<Token>> published;
+public:
+    const PersistentVector<Token>& get_tokens() const {
+        return tokens;
+    }
+
+    // Adds the token and returns a snapshot of all of the tokens, in O(log n).
+    TokenMemento add_token(int value) {
+        tokens = tokens.push_back(Token{value});
+        published.store(tokens);
+        return {tokens};
+    }
+    // Reverts to the state the memento was taken in, in O(1).
+    void revert(const TokenMemento& memento) {
+        tokens = memento.get_tokens();
+        published.store(tokens);
+    }
+
+    // The latest tokens. Neither this nor the thread adding tokens locks, see
+    // SharedSnapshot.
+    TokenMemento snapshot() const {
+        return {*published.load()};
+    }
+};
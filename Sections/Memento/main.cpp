@@ -1,5 +1,12 @@
 #include <iostream>
+#include <memory>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <atomic>
 #include "BankAccount.h"
+#include "TokenMachine.h"
 
 void external_memento() {
     BankAccount ba{100};
@@ -30,10 +37,210 @@ void stored_memento() {
     std::cout << "Redo once: " << ba << std::endl;
 }
 
+// Counts the bytes allocated through it.
+template <typename T>
+class CountingAllocator {
+public:
+    using value_type = T;
+    size_t* bytes;
+
+    CountingAllocator(size_t* bytes) : bytes(bytes) {}
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other) : bytes(other.bytes) {}
+
+    T* allocate(size_t n) {
+        *bytes += n * sizeof(T);
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        std::allocator<T>{}.deallocate(p, n);
+    }
+    bool operator==(const CountingAllocator& other) const {
+        return bytes == other.bytes;
+    }
+    bool operator!=(const CountingAllocator& other) const {
+        return bytes != other.bytes;
+    }
+};
+
+void history_memory() {
+    const size_t operations{1'000'000};
+
+    // A snapshot per deposit, as BankAccount2 used to store them.
+    size_t snapshot_bytes{};
+    {
+        std::vector<std::shared_ptr<Memento>> changes;
+        for(size_t i{}; i < operations; ++i) {
+            changes.push_back(std::allocate_shared<Memento>(
+                    CountingAllocator<Memento>{&snapshot_bytes}, static_cast<int>(i)));
+        }
+        snapshot_bytes += changes.capacity() * sizeof(std::shared_ptr<Memento>);
+    }
+
+    BankAccount2 ba{0, operations};
+    for(size_t i{}; i < operations; ++i) {
+        ba.deposit(1);
+    }
+    for(size_t i{}; i < operations; ++i) {
+        ba.undo();
+    }
+    std::cout << "Memory per operation over " << operations << " deposits:" << std::endl
+              << "  shared_ptr snapshots: " << static_cast<double>(snapshot_bytes) / operations
+              << " bytes (" << operations << " allocations)" << std::endl
+              << "  Delta history:        " << static_cast<double>(ba.get_history().memory_usage()) / operations
+              << " bytes (no allocations after construction)" << std::endl
+              << "  Balance after undoing everything: " << ba.get_balance() << std::endl;
+
+    // Bounded to the last 100 changes.
+    BankAccount2 bounded{0, 100};
+    for(int i{}; i < 1000; ++i) {
+        bounded.deposit(1);
+    }
+    while(bounded.undo()) {}
+    std::cout << "  Depth 100 history after 1000 deposits undoes back to: "
+              << bounded.get_balance() << std::endl;
+}
+
+void token_machine() {
+    using namespace std::chrono;
+    const int token_count{10'000};
+
+    // Snapshot on every edit by copying every token.
+    auto start = steady_clock::now();
+    std::vector<std::vector<Token>> copies;
+    std::vector<Token> tokens;
+    for(int i{}; i < token_count; ++i) {
+        tokens.emplace_back(i);
+        copies.push_back(tokens);
+    }
+    auto copy_time = duration_cast<milliseconds>(steady_clock::now() - start);
+    copies.clear();
+
+    // Snapshot on every edit sharing structure.
+    start = steady_clock::now();
+    TokenMachine machine;
+    std::vector<TokenMemento> mementos;
+    for(int i{}; i < token_count; ++i) {
+        mementos.push_back(machine.add_token(i));
+    }
+    auto shared_time = duration_cast<milliseconds>(steady_clock::now() - start);
+
+    machine.revert(mementos[token_count / 2 - 1]);
+    const auto& reverted = machine.get_tokens();
+    std::cout << "Snapshotting after each of " << token_count << " tokens:" << std::endl
+              << "  Copying:             " << copy_time.count() << "ms" << std::endl
+              << "  Structural sharing:  " << shared_time.count() << "ms" << std::endl
+              << "  Reverted to " << reverted.size() << " tokens, last is "
+              << reverted[reverted.size() - 1].value << std::endl;
+}
+
+void spilling_history() {
+    auto path = (std::filesystem::temp_directory_path() / "account.history").string();
+    const int deposits{1'000'000};
+    // Keep 16KB of history in memory, the rest goes to disk.
+    BankAccount3 ba{0, path, 16 * 1024};
+    std::vector<int> balances{0};
+    std::mt19937 random;
+    std::uniform_int_distribution<int> amounts{-100, 100};
+    for(int i{}; i < deposits; ++i) {
+        balances.push_back(ba.deposit(amounts(random)).get_balance());
+    }
+    std::cout << "After " << deposits << " deposits:" << std::endl
+              << "  In memory: " << ba.get_history().memory_usage() / 1024 << "KB, on disk: "
+              << ba.get_history().disk_usage() / 1024 << "KB" << std::endl;
+
+    // Undo all the way back, paging history in from disk, then half way forward again.
+    bool match{true};
+    for(int i{deposits}; i > 0; --i) {
+        ba.undo();
+        match = match && ba.get_balance() == balances[i-1];
+    }
+    // The states that could be redone are spilled too, so this stays within budget.
+    std::cout << "  After undoing everything:" << std::endl
+              << "  In memory: " << ba.get_history().memory_usage() / 1024 << "KB, on disk: "
+              << ba.get_history().disk_usage() / 1024 << "KB" << std::endl;
+    for(int i{}; i < deposits / 2; ++i) {
+        ba.redo();
+        match = match && ba.get_balance() == balances[i+1];
+    }
+    // Replacing the rest of the history leaves dead pages for the compactor.
+    for(int i{}; i < deposits / 2; ++i) {
+        ba.deposit(1);
+    }
+    std::cout << "  After undoing everything, redoing half and replacing the rest:" << std::endl
+              << "  In memory: " << ba.get_history().memory_usage() / 1024 << "KB, on disk: "
+              << ba.get_history().disk_usage() / 1024 << "KB, compactions: "
+              << ba.get_history().get_compactions() << std::endl;
+    if(auto error = ba.get_history().get_compaction_error(); !error.empty()) {
+        std::cout << "  Last compaction failed: " << error << std::endl;
+    }
+    std::cout << "  Balances match: " << std::boolalpha << match << std::endl;
+}
+
+void concurrent_snapshots() {
+    const int deposits{1'000'000};
+    const size_t reader_count{3};
+    BankAccount2 ba{100, 64};
+    TokenMachine machine;
+    std::atomic<bool> done{false};
+    std::atomic<size_t> reads{}, inconsistent{};
+
+    // Readers check that every snapshot is internally consistent.
+    std::vector<std::thread> readers;
+    for(size_t r{}; r < reader_count; ++r) {
+        readers.emplace_back([&]() {
+            size_t count{}, bad{}, last_version{}, last_size{};
+            while(!done.load(std::memory_order_acquire)) {
+                // Each deposit is 1, so balance and version move together.
+                AccountState state = ba.get_state();
+                bad += state.balance != 100 + static_cast<int>(state.version);
+                bad += state.version < last_version;
+                last_version = state.version;
+
+                auto tokens = machine.snapshot().get_tokens();
+                bad += tokens.size() < last_size;
+                last_size = tokens.size();
+                if(!tokens.empty()) {
+                    size_t last = tokens.size() - 1;
+                    bad += tokens[last].value != static_cast<int>(last);
+                    bad += tokens[last / 2].value != static_cast<int>(last / 2);
+                }
+                ++count;
+            }
+            reads += count;
+            inconsistent += bad;
+        });
+    }
+    for(int i{}; i < deposits; ++i) {
+        ba.deposit(1);
+        if(i % 10 == 0) {
+            machine.add_token(i / 10);
+        }
+    }
+    done = true;
+    for(auto& reader : readers) {
+        reader.join();
+    }
+    std::cout << "Writer made " << deposits << " deposits while " << reader_count
+              << " readers took " << reads << " snapshots, " << inconsistent
+              << " inconsistent" << std::endl
+              << "Final state: balance " << ba.get_state().balance << ", version "
+              << ba.get_state().version << ", tokens " << machine.snapshot().get_tokens().size()
+              << std::endl;
+}
+
 int main() {
     external_memento();
     std::cout << std::endl;
     stored_memento();
+    std::cout << std::endl;
+    history_memory();
+    std::cout << std::endl;
+    token_machine();
+    std::cout << std::endl;
+    spilling_history();
+    std::cout << std::endl;
+    concurrent_snapshots();
 
     return 0;
 }
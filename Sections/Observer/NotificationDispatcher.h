@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of threads that delivers notifications for Observables in asynchronous
+// mode. Workers take every queued delivery at once and run them as a batch.
+class NotificationDispatcher {
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::deque<std::function<void()>> deliveries;
+    std::vector<std::thread> workers;
+    size_t busy{}; // Workers running a batch.
+    bool stopping{false};
+
+    void run() {
+        std::unique_lock lock{mutex};
+        while(true) {
+            wake.wait(lock, [this]() { return stopping || !deliveries.empty(); });
+            if(deliveries.empty()) { // Stopping, and everything's been delivered.
+                return;
+            }
+            auto batch = std::move(deliveries);
+            deliveries.clear();
+            ++busy;
+            lock.unlock();
+            for(auto& delivery : batch) {
+                delivery();
+            }
+            lock.lock();
+            --busy;
+            if(busy == 0 && deliveries.empty()) {
+                idle.notify_all();
+            }
+        }
+    }
+public:
+    explicit NotificationDispatcher(size_t thread_count = 1) {
+        for(size_t i{}; i < std::max<size_t>(thread_count, 1); ++i) {
+            workers.emplace_back(&NotificationDispatcher::run, this);
+        }
+    }
+    // Delivers anything still queued before returning.
+    ~NotificationDispatcher() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& worker : workers) {
+            worker.join();
+        }
+    }
+    NotificationDispatcher(const NotificationDispatcher&) = delete;
+    NotificationDispatcher& operator=(const NotificationDispatcher&) = delete;
+
+    void post(std::function<void()> delivery) {
+        {
+            std::lock_guard lock{mutex};
+            deliveries.push_back(std::move(delivery));
+        }
+        wake.notify_one();
+    }
+    // Waits until everything posted so far has been delivered.
+    void wait_idle() {
+        std::unique_lock lock{mutex};
+        idle.wait(lock, [this]() { return busy == 0 && deliveries.empty(); });
+    }
+};
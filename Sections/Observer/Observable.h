@@ -1,26 +1,250 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <memory>
-#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include "NotificationDispatcher.h"
+#include "Subscription.h"
 
-template <typename> class Observer;
+template <typename, typename> class Observer;
 
-template <typename T>
+// Field is an enum of T's fields, with a final count enumerator, e.g.
+//     enum class PersonField {age, name, count};
+// Observers subscribe to individual fields, and notify() goes straight to the
+// subscribers of the field that changed, so nothing compares field names and
+// observers aren't woken for fields they don't care about.
+// Observers are held weakly, so subscribing doesn't keep them alive, and
+// subscribe() returns a Subscription that unsubscribes in O(1). Subscriptions
+// live in a slot map; a slot is reused once it's unsubscribed or its observer
+// has expired, and expired observers are purged lazily.
+// Safe to use from multiple threads. Each field's subscribers are a list that
+// notify() atomically loads and iterates without holding a lock. Subscribing
+// appends to the list in place, past the end readers can see, until it's full.
+// Unsubscribing just marks the entry as inactive, and once inactive entries
+// outnumber active ones the list is copied without them. Either way a list is
+// only copied after a number of changes proportional to its size, so
+// subscribing and unsubscribing cost amortised O(1) and notify() never has to
+// rebuild anything.
+// So observers can also unsubscribe from within field_changed().
+// Given a NotificationDispatcher, notify() only marks the field as changed and
+// the dispatcher's threads deliver it later, so slow observers don't hold up
+// the thread making changes. Changes to a field before it's delivered are
+// coalesced into one notification, and observers read the latest value from
+// the source, so T's getters must be safe to call from other threads.
+template <typename T, typename Field>
 class Observable {
-    std::vector<std::shared_ptr<Observer<T>>> observers;
+    using ObserverPtr = std::shared_ptr<Observer<T, Field>>;
+    static constexpr size_t field_count{static_cast<size_t>(Field::count)};
+    static_assert(field_count <= 64, "Field masks are 64 bit");
+
+    struct Subscriber {
+        std::weak_ptr<Observer<T, Field>> observer;
+        uint32_t slot{}, generation{};
+        std::atomic<bool> active{true};
+    };
+    // Entries below size are never changed, so readers can iterate them while
+    // more are appended.
+    struct SubscriberList {
+        std::vector<std::shared_ptr<Subscriber>> entries; // Sized to the capacity.
+        std::atomic<size_t> size{};
+
+        explicit SubscriberList(size_t capacity) : entries(capacity) {}
+    };
+
+    class Registry : public SubscriptionRegistry {
+        static constexpr size_t min_capacity{8};
+
+        struct Slot {
+            std::shared_ptr<Subscriber> subscriber;
+            uint64_t fields{}; // Zero if the slot is free.
+            uint32_t generation{};
+        };
+        struct FieldSubscribers {
+            std::shared_ptr<SubscriberList> list; // Accessed atomically.
+            size_t active{}, inactive{};
+        };
+
+        std::mutex mutex;
+        std::vector<Slot> slots;
+        std::vector<uint32_t> free_slots;
+        std::array<FieldSubscribers, field_count> fields;
+
+        // Copies the active entries into a new list with room for as many again.
+        void compact(FieldSubscribers& field) {
+            auto old_list = field.list;
+            auto list = std::make_shared<SubscriberList>(std::max(2 * field.active, min_capacity));
+            size_t size{};
+            for(size_t i{}; i < old_list->size.load(std::memory_order_relaxed); ++i) {
+                if(old_list->entries[i]->active.load(std::memory_order_relaxed)) {
+                    list->entries[size++] = old_list->entries[i];
+                }
+            }
+            list->size.store(size, std::memory_order_relaxed);
+            field.inactive = 0;
+            std::atomic_store_explicit(&field.list, std::move(list), std::memory_order_release);
+        }
+    public:
+        Registry() {
+            for(auto& field : fields) {
+                field.list = std::make_shared<SubscriberList>(min_capacity);
+            }
+        }
+
+        std::pair<uint32_t, uint32_t> add(const ObserverPtr& observer, uint64_t field_mask) {
+            std::lock_guard lock{mutex};
+            uint32_t index;
+            if(free_slots.empty()) {
+                index = static_cast<uint32_t>(slots.size());
+                slots.emplace_back();
+            } else {
+                index = free_slots.back();
+                free_slots.pop_back();
+            }
+            Slot& slot = slots[index];
+            slot.subscriber = std::make_shared<Subscriber>();
+            slot.subscriber->observer = observer;
+            slot.subscriber->slot = index;
+            slot.subscriber->generation = slot.generation;
+            slot.fields = field_mask;
+            for(size_t i{}; i < field_count; ++i) {
+                if(field_mask & (uint64_t{1} << i)) {
+                    FieldSubscribers& field = fields[i];
+                    if(field.list->size.load(std::memory_order_relaxed) == field.list->entries.size()) {
+                        compact(field);
+                    }
+                    auto& list = *field.list;
+                    size_t size = list.size.load(std::memory_order_relaxed);
+                    list.entries[size] = slot.subscriber;
+                    list.size.store(size + 1, std::memory_order_release);
+                    ++field.active;
+                }
+            }
+            return {index, slot.generation};
+        }
+        // Also used to purge observers that have expired.
+        void remove(uint32_t index, uint32_t generation) override {
+            std::lock_guard lock{mutex};
+            if(index >= slots.size() || slots[index].generation != generation ||
+               slots[index].fields == 0) {
+                return;
+            }
+            Slot& slot = slots[index];
+            slot.subscriber->active.store(false, std::memory_order_release);
+            for(size_t i{}; i < field_count; ++i) {
+                if(slot.fields & (uint64_t{1} << i)) {
+                    FieldSubscribers& field = fields[i];
+                    --field.active;
+                    ++field.inactive;
+                    if(field.inactive >= min_capacity && field.inactive > field.active) {
+                        compact(field);
+                    }
+                }
+            }
+            slot.subscriber.reset();
+            slot.fields = 0;
+            ++slot.generation;
+            free_slots.push_back(index);
+        }
+
+        std::shared_ptr<SubscriberList> load(size_t field) const {
+            return std::atomic_load_explicit(&fields[field].list, std::memory_order_acquire);
+        }
+    };
+
+    std::shared_ptr<Registry> registry{std::make_shared<Registry>()};
+
+    NotificationDispatcher* dispatcher{};
+    std::atomic<uint64_t> pending{}; // Fields changed but not yet delivered.
+    // Set while a delivery is posted or running, and only taken by CAS, so at
+    // most one dispatcher thread delivers this observable's changes at a time.
+    std::atomic<bool> draining{false};
+    std::atomic<size_t> in_flight{}; // Deliveries posted but not finished.
+
+    static size_t index(Field field) {
+        return static_cast<size_t>(field);
+    }
+    void deliver(T& source, Field field) {
+        auto list = registry->load(index(field)); // Keeps this version alive while iterating.
+        size_t size = list->size.load(std::memory_order_acquire);
+        for(size_t i{}; i < size; ++i) {
+            const Subscriber& subscriber = *list->entries[i];
+            if(!subscriber.active.load(std::memory_order_acquire)) {
+                continue;
+            }
+            if(auto observer = subscriber.observer.lock()) {
+                observer->field_changed(source, field);
+            } else {
+                registry->remove(subscriber.slot, subscriber.generation);
+            }
+        }
+    }
+    void deliver_pending(T& source) {
+        while(true) {
+            uint64_t fields = pending.exchange(0, std::memory_order_acq_rel);
+            for(size_t i{}; i < field_count; ++i) {
+                if(fields & (uint64_t{1} << i)) {
+                    deliver(source, static_cast<Field>(i));
+                }
+            }
+            // A notify() that found the flag taken left its change pending, so
+            // check for one after letting go and take the flag back if there is.
+            draining.store(false);
+            bool expected{false};
+            if(pending.load() == 0 || !draining.compare_exchange_strong(expected, true)) {
+                break;
+            }
+        }
+        in_flight.fetch_sub(1, std::memory_order_release);
+    }
 public:
-    void notify(T& source, const std::string& field_name) {
-        for(auto& observer : observers) {
-            observer->field_changed(source, field_name);
+    Observable() = default;
+    // Waits for deliveries that are already queued. T's own members are gone
+    // by now, so T should call flush() in its destructor if it's asynchronous.
+    ~Observable() {
+        flush();
+    }
+
+    // Nullptr, the default, delivers notifications synchronously. The
+    // dispatcher must outlive this.
+    void set_dispatcher(NotificationDispatcher* dispatcher) {
+        flush();
+        this->dispatcher = dispatcher;
+    }
+    // Waits until every notification so far has been delivered.
+    void flush() {
+        while(in_flight.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    void notify(T& source, Field field) {
+        if(!dispatcher) {
+            deliver(source, field);
+            return;
+        }
+        pending.fetch_or(uint64_t{1} << index(field));
+        bool expected{false};
+        if(draining.compare_exchange_strong(expected, true)) {
+            in_flight.fetch_add(1, std::memory_order_relaxed);
+            dispatcher->post([this, &source]() {
+                deliver_pending(source);
+            });
         }
     }
-    void subscribe(const std::shared_ptr<Observer<T>>& observer) {
-        observers.push_back(observer);
+    // The observer must be kept alive elsewhere, and stays subscribed until the
+    // Subscription is destroyed or the observer expires.
+    [[nodiscard]] Subscription subscribe(const ObserverPtr& observer, Field field) {
+        auto [slot, generation] = registry->add(observer, uint64_t{1} << index(field));
+        return {registry, slot, generation};
     }
-    void unsubscribe(const std::shared_ptr<Observer<T>>& observer) {
-        observers.erase(
-                std::remove(observers.begin(), observers.end(), observer),
-                observers.end());
+    // Subscribes to every field.
+    [[nodiscard]] Subscription subscribe(const ObserverPtr& observer) {
+        uint64_t all = field_count == 64 ? ~uint64_t{} : (uint64_t{1} << field_count) - 1;
+        auto [slot, generation] = registry->add(observer, all);
+        return {registry, slot, generation};
     }
 };
\ No newline at end of file
@@ -1,9 +1,9 @@
 #pragma once
 
-#include <string>
-
-template <typename T>
+// Field is an enum identifying the fields of T that can change, see Observable.
+template <typename T, typename Field>
 class Observer {
 public:
-    virtual void field_changed(T& source, const std::string& field_name) = 0;
+    virtual ~Observer() = default;
+    virtual void field_changed(T& source, Field field) = 0;
 };
\ No newline at end of file
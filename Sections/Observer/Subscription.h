@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+// Implemented by whatever keeps track of subscriptions, e.g. an Observable.
+class SubscriptionRegistry {
+public:
+    virtual ~SubscriptionRegistry() = default;
+    virtual void remove(uint32_t slot, uint32_t generation) = 0;
+};
+
+// Handle to a subscription that unsubscribes when it's destroyed, or earlier
+// with unsubscribe(). Unsubscribing is O(1). If the registry has already
+// gone, or the slot has been reused, it does nothing.
+class Subscription {
+    std::weak_ptr<SubscriptionRegistry> registry;
+    uint32_t slot{};
+    uint32_t generation{};
+public:
+    Subscription() = default;
+    Subscription(std::weak_ptr<SubscriptionRegistry> registry, uint32_t slot, uint32_t generation)
+        : registry{std::move(registry)}, slot{slot}, generation{generation} {}
+    ~Subscription() {
+        unsubscribe();
+    }
+
+    Subscription(const Subscription&) = delete;
+    Subscription& operator=(const Subscription&) = delete;
+    Subscription(Subscription&& other) noexcept
+        : registry{std::move(other.registry)}, slot{other.slot}, generation{other.generation} {
+        other.registry.reset();
+    }
+    Subscription& operator=(Subscription&& other) noexcept {
+        if(this != &other) {
+            unsubscribe();
+            registry = std::move(other.registry);
+            slot = other.slot;
+            generation = other.generation;
+            other.registry.reset();
+        }
+        return *this;
+    }
+
+    void unsubscribe() {
+        if(auto locked = registry.lock()) {
+            locked->remove(slot, generation);
+        }
+        registry.reset();
+    }
+};
@@ -1,11 +1,33 @@
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <vector>
 #include "Observable.h"
 #include "Observer.h"
 
-class Person : public Observable<Person> { // Observable.
-    int age;
+enum class PersonField {age, name, count};
+
+const char* to_string(PersonField field) {
+    switch(field) {
+        case PersonField::age: return "age";
+        case PersonField::name: return "name";
+        default: return "unknown";
+    }
+}
+
+// Getters are safe to call while another thread sets, as asynchronous
+// observers read them from the dispatcher's threads.
+class Person : public Observable<Person, PersonField> { // Observable.
+    std::atomic<int> age;
+    std::string name;
+    mutable std::mutex name_mutex;
 public:
     Person(int age) : age(age) {}
+    ~Person() {
+        flush();
+    }
 
     int get_age() const {
         return age;
@@ -15,29 +37,176 @@ public:
             return;
         }
         Person::age = age;
-        notify(*this, "age");
+        notify(*this, PersonField::age);
+    }
+    std::string get_name() const {
+        std::lock_guard lock{name_mutex};
+        return name;
+    }
+    void set_name(const std::string& name) {
+        {
+            std::lock_guard lock{name_mutex};
+            if(Person::name == name) {
+                return;
+            }
+            Person::name = name;
+        }
+        notify(*this, PersonField::name);
     }
 };
 
-class ConsolePersonObserver : public Observer<Person> {
-    void field_changed(Person& source, const std::string& field_name) override {
-        std::cout << "Person's " << field_name << " has changed to ";
-        if(field_name == "age") {
-            std::cout << source.get_age();
+class ConsolePersonObserver : public Observer<Person, PersonField> {
+    void field_changed(Person& source, PersonField field) override {
+        std::cout << "Person's " << to_string(field) << " has changed to ";
+        switch(field) {
+            case PersonField::age: {
+                std::cout << source.get_age();
+                break;
+            }
+            case PersonField::name: {
+                std::cout << source.get_name();
+                break;
+            }
+            default: break;
         }
         std::cout << std::endl;
     }
 public:
 };
 
+class CountingObserver : public Observer<Person, PersonField> {
+public:
+    std::atomic<size_t> count{};
+
+    void field_changed(Person&, PersonField) override {
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Unsubscribes itself the first time it's notified.
+class OneShotObserver : public Observer<Person, PersonField> {
+public:
+    std::atomic<size_t> count{};
+    Subscription subscription;
+
+    void field_changed(Person&, PersonField) override {
+        if(count.fetch_add(1) == 0) {
+            subscription.unsubscribe();
+        }
+    }
+};
+
+void concurrent_notifications() {
+    Person person(0);
+    auto counter = std::make_shared<CountingObserver>();
+    auto one_shot = std::make_shared<OneShotObserver>();
+    auto counter_subscription = person.subscribe(counter, PersonField::age);
+    one_shot->subscription = person.subscribe(one_shot, PersonField::age);
+
+    const size_t notifier_count{4}, notifications{250'000};
+    std::atomic<bool> done{false};
+    std::atomic<size_t> churned{};
+    // Churns the subscribers while the notifiers run. Half are unsubscribed by
+    // their token, the rest expire with the token kept and are purged lazily.
+    std::thread churn([&]() {
+        std::vector<Subscription> kept;
+        while(!done) {
+            auto transient = std::make_shared<CountingObserver>();
+            auto subscription = person.subscribe(transient, PersonField::age);
+            if(churned.fetch_add(1) % 2 == 0) {
+                kept.push_back(std::move(subscription));
+            }
+        }
+    });
+    std::vector<std::thread> notifiers;
+    for(size_t i{}; i < notifier_count; ++i) {
+        notifiers.emplace_back([&]() {
+            for(size_t n{}; n < notifications; ++n) {
+                person.notify(person, PersonField::age);
+            }
+        });
+    }
+    for(auto& notifier : notifiers) {
+        notifier.join();
+    }
+    done = true;
+    churn.join();
+    // Notifications already in flight may reach it after it unsubscribes, later ones don't.
+    size_t one_shot_count = one_shot->count;
+    size_t counted = counter->count;
+    person.notify(person, PersonField::age);
+    std::cout << "Counting observer received " << counted << " of "
+              << notifier_count * notifications << " notifications" << std::endl
+              << "One shot observer unsubscribed itself: " << std::boolalpha
+              << (one_shot->count == one_shot_count) << std::endl
+              << churned << " transient subscribers came and went" << std::endl;
+}
+
+class SlowObserver : public Observer<Person, PersonField> {
+public:
+    std::atomic<size_t> count{};
+    std::atomic<int> last_age{};
+    std::atomic<int> delivering{};
+    std::atomic<bool> overlapped{false}; // Notified on two threads at once.
+
+    void field_changed(Person& source, PersonField) override {
+        if(delivering.fetch_add(1) != 0) {
+            overlapped = true;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds{100});
+        last_age = source.get_age();
+        ++count;
+        delivering.fetch_sub(1);
+    }
+};
+
+void asynchronous_notifications() {
+    using namespace std::chrono;
+    NotificationDispatcher dispatcher{2};
+    Person person(0);
+    person.set_dispatcher(&dispatcher);
+    std::vector<std::shared_ptr<SlowObserver>> observers;
+    std::vector<Subscription> subscriptions;
+    for(int i{}; i < 10; ++i) {
+        observers.push_back(std::make_shared<SlowObserver>());
+        subscriptions.push_back(person.subscribe(observers.back(), PersonField::age));
+    }
+
+    const int changes{100'000};
+    auto start = steady_clock::now();
+    for(int age{1}; age <= changes; ++age) {
+        person.set_age(age);
+    }
+    auto time = duration_cast<milliseconds>(steady_clock::now() - start);
+    person.flush();
+
+    std::cout << changes << " age changes with " << observers.size()
+              << " slow observers took the producer " << time.count() << "ms" << std::endl
+              << "Each observer was notified " << observers.front()->count
+              << " times and last saw age " << observers.front()->last_age << std::endl
+              << "Deliveries overlapped: " << std::boolalpha << observers.front()->overlapped << std::endl;
+}
+
 int main() {
     Person person(10);
     auto cpo = std::make_shared<ConsolePersonObserver>();
-    person.subscribe(cpo);
+    auto subscription = person.subscribe(cpo, PersonField::age);
     person.set_age(11);
+    person.set_name("Sam"); // Not subscribed to name.
     person.set_age(12);
-    person.unsubscribe(cpo);
+    subscription.unsubscribe();
     person.set_age(13);
 
+    subscription = person.subscribe(cpo);
+    person.set_name("Sally");
+    cpo.reset(); // Observers are held weakly, so it's no longer notified.
+    person.set_age(14);
+    std::cout << std::endl;
+
+    concurrent_notifications();
+    std::cout << std::endl;
+
+    asynchronous_notifications();
+
     return 0;
 }
\ No newline at end of file